@@ -0,0 +1,223 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <argparse/argparse.hpp>
+
+#include <fmt/ostream.h>
+#include <fmt/format.h>
+
+#include <yapl/yapl.hpp>
+
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include <new>
+
+#include <cstdlib>
+#include <cstdio>
+
+// every heap allocation of the process is counted, the benchmark reads the
+// counter around the phase it measures
+namespace
+{
+    std::atomic_size_t allocated = 0;
+
+    void *allocate(std::size_t size, std::size_t align = 0)
+    {
+        allocated.fetch_add(size, std::memory_order_relaxed);
+
+        void *ptr = (align > alignof(std::max_align_t))
+            ? std::aligned_alloc(align, (size + align - 1) / align * align)
+            : std::malloc(size ? size : 1);
+
+        if (ptr == nullptr)
+            throw std::bad_alloc { };
+        return ptr;
+    }
+} // namespace
+
+void *operator new(std::size_t size) { return allocate(size); }
+void *operator new[](std::size_t size) { return allocate(size); }
+void *operator new(std::size_t size, std::align_val_t align) { return allocate(size, static_cast<std::size_t>(align)); }
+void *operator new[](std::size_t size, std::align_val_t align) { return allocate(size, static_cast<std::size_t>(align)); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace
+{
+    struct sample
+    {
+        double lex_seconds;
+        double parse_seconds;
+        std::size_t lex_bytes;
+        std::size_t parse_bytes;
+    };
+
+    struct measured
+    {
+        std::size_t tokens;
+        std::size_t functions;
+        std::vector<sample> samples;
+    };
+
+    template<typename Func>
+    std::pair<double, std::size_t> measure(Func &&func)
+    {
+        auto bytes = allocated.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+
+        func();
+
+        auto end = std::chrono::steady_clock::now();
+        return { std::chrono::duration<double>(end - start).count(), allocated.load(std::memory_order_relaxed) - bytes };
+    }
+
+    // a fresh unit per iteration, only tokenising and parsing are timed
+    measured run(const std::string &source, std::size_t iterations)
+    {
+        measured res { 0, 0, { } };
+        for (std::size_t i = 0; i < iterations; i++)
+        {
+            yapl::unit mod { "x86_64-pc-linux-gnu", "<bench>", source };
+
+            auto [lex_seconds, lex_bytes] = measure([&] { mod.tokeniser.tokenise(); });
+            auto [parse_seconds, parse_bytes] = measure([&] { mod.parser.parse(); });
+
+            // errors are collected rather than thrown, a corpus that doesn't parse would time error recovery
+            if (mod.diagnostics.errors() != 0)
+            {
+                mod.diagnostics.flush(stderr);
+                throw std::runtime_error("the generated source doesn't parse");
+            }
+
+            res.tokens = mod.tokeniser.tokens().size();
+            res.functions = mod.func_registry.size();
+            res.samples.push_back({ lex_seconds, parse_seconds, lex_bytes, parse_bytes });
+        }
+        return res;
+    }
+
+    double median(std::vector<double> values)
+    {
+        std::ranges::sort(values);
+        auto mid = values.size() / 2;
+        return (values.size() % 2) ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+    }
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+    argparse::ArgumentParser parser("yapl-bench", YAPL_VERSION);
+
+    parser.add_argument("-n", "--functions")
+        .default_value(std::size_t(2000))
+        .scan<'u', std::size_t>()
+        .help("number of functions in the generated source");
+
+    parser.add_argument("-m", "--statements")
+        .default_value(std::size_t(20))
+        .scan<'u', std::size_t>()
+        .help("statements per function");
+
+    parser.add_argument("-d", "--depth")
+        .default_value(std::size_t(4))
+        .scan<'u', std::size_t>()
+        .help("nesting depth of expressions");
+
+    parser.add_argument("-c", "--comments")
+        .default_value(0.1)
+        .scan<'g', double>()
+        .help("chance of a comment before each statement");
+
+    parser.add_argument("-s", "--string-length")
+        .default_value(std::size_t(0))
+        .scan<'u', std::size_t>()
+        .help("length of string literals, 0 for none");
+
+    parser.add_argument("--statement-mix")
+        .flag()
+        .help("statements are only declarations alternating with calls, e.g. -n 50 -m 2000 for 50k of each");
+
+    parser.add_argument("--seed")
+        .default_value(std::uint64_t(1))
+        .scan<'u', std::uint64_t>();
+
+    parser.add_argument("-r", "--iterations")
+        .default_value(std::size_t(10))
+        .scan<'u', std::size_t>();
+
+    parser.add_argument("--dump")
+        .help("also write the generated source to this file");
+
+    try {
+        parser.parse_args(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "{}", e.what());
+        fmt::println(stderr, "{}", fmt::streamed(parser));
+        return EXIT_FAILURE;
+    }
+
+    bench::corpus_options opts {
+        .functions = parser.get<std::size_t>("-n"),
+        .statements = parser.get<std::size_t>("-m"),
+        .depth = parser.get<std::size_t>("-d"),
+        .comments = parser.get<double>("-c"),
+        .string_length = parser.get<std::size_t>("-s"),
+        .statement_mix = parser.get<bool>("--statement-mix"),
+        .seed = parser.get<std::uint64_t>("--seed")
+    };
+    auto iterations = std::max(parser.get<std::size_t>("-r"), std::size_t(1));
+
+    auto source = bench::corpus { opts }.generate();
+    if (auto path = parser.present("--dump"))
+        std::ofstream { *path } << source;
+
+    measured res;
+    try {
+        res = run(source, iterations);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "{}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<double> lex, parse;
+    for (const auto &smp : res.samples)
+    {
+        lex.push_back(smp.lex_seconds);
+        parse.push_back(smp.parse_seconds);
+    }
+
+    auto lex_time = median(lex);
+    auto parse_time = median(parse);
+    const auto &last = res.samples.back();
+
+    fmt::println("source      {:.2f} MiB, {} tokens, {} functions, {} iterations",
+        source.size() / 1048576.0, res.tokens, res.functions, iterations);
+    fmt::println("lexer       {:>10.3f} ms  {:>8.2f} Mtokens/s  {:>8.2f} MiB/s  {:>7.2f} bytes allocated/token",
+        lex_time * 1000, res.tokens / lex_time / 1e6, source.size() / lex_time / 1048576.0, double(last.lex_bytes) / res.tokens);
+    fmt::println("parser      {:>10.3f} ms  {:>8.2f} Kfuncs/s   {:>8.2f} Mtokens/s  {:>7.2f} bytes allocated/token",
+        parse_time * 1000, res.functions / parse_time / 1e3, res.tokens / parse_time / 1e6, double(last.parse_bytes) / res.tokens);
+
+    if (opts.statement_mix)
+    {
+        auto statements = opts.functions * opts.statements;
+        fmt::println("statements  {:>10} total     {:>8.2f} Mstmts/s", statements, statements / parse_time / 1e6);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <fmt/format.h>
+
+#include <string_view>
+#include <iterator>
+#include <string>
+#include <random>
+#include <vector>
+#include <array>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace bench
+{
+    struct corpus_options
+    {
+        std::size_t functions = 1000;
+        std::size_t statements = 20;
+        // nesting of the expression trees
+        std::size_t depth = 4;
+        // chance of a comment before a statement
+        double comments = 0.1;
+        // 0 means no string literals
+        std::size_t string_length = 0;
+        // only declarations alternating with call statements, to time the statement loop itself
+        bool statement_mix = false;
+        std::uint64_t seed = 1;
+    };
+
+    // deterministic for the same options, and valid yapl all the way to codegen
+    struct corpus
+    {
+        private:
+        static constexpr std::array<std::string_view, 14> binary_ops
+        {
+            "+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>", "==", "!=", "<", ">="
+        };
+
+        static constexpr std::array<std::string_view, 4> assign_ops
+        {
+            "=", "+=", "-=", "*="
+        };
+
+        const corpus_options &_opts;
+        std::mt19937_64 _rng;
+        std::string _out;
+
+        // names usable in the current function
+        std::vector<std::string> _vars;
+
+        std::size_t pick(std::size_t n)
+        {
+            return std::uniform_int_distribution<std::size_t> { 0, n - 1 } (this->_rng);
+        }
+
+        bool chance(double p)
+        {
+            return std::bernoulli_distribution { p } (this->_rng);
+        }
+
+        void comment()
+        {
+            if (this->chance(0.5))
+                this->_out += "    // a line comment, the lexer skips all of this text\n";
+            else
+                this->_out += "    /* a block comment\n     * spanning a few lines\n     */\n";
+        }
+
+        void expression(std::size_t depth)
+        {
+            if (depth == 0)
+            {
+                if (this->chance(0.5))
+                    this->_out += this->_vars[this->pick(this->_vars.size())];
+                else
+                    fmt::format_to(std::back_inserter(this->_out), "{}", this->pick(100000));
+                return;
+            }
+
+            this->_out += '(';
+            this->expression(depth - 1);
+            fmt::format_to(std::back_inserter(this->_out), " {} ", binary_ops[this->pick(binary_ops.size())]);
+            this->expression(depth - 1 - this->pick(depth));
+            this->_out += ')';
+        }
+
+        void statement(std::size_t func, std::size_t index)
+        {
+            if (this->_opts.comments > 0 && this->chance(this->_opts.comments))
+                this->comment();
+
+            this->_out += "    ";
+            switch (this->pick(this->_opts.string_length > 0 ? 4 : 3))
+            {
+                case 0:
+                {
+                    auto name = fmt::format("v{}", index);
+                    this->_out += "i32: " + name + " = ";
+                    this->expression(this->_opts.depth);
+                    this->_vars.push_back(std::move(name));
+                    break;
+                }
+                case 1:
+                    fmt::format_to(std::back_inserter(this->_out), "{} {} ", this->_vars[this->pick(this->_vars.size())], assign_ops[this->pick(assign_ops.size())]);
+                    this->expression(this->_opts.depth);
+                    break;
+                case 2:
+                    // earlier functions only, so the call graph has no cycles
+                    if (func == 0)
+                    {
+                        this->expression(this->_opts.depth);
+                        break;
+                    }
+                    fmt::format_to(std::back_inserter(this->_out), "f{}(", this->pick(func));
+                    this->expression(this->_opts.depth / 2);
+                    this->_out += ", ";
+                    this->expression(this->_opts.depth / 2);
+                    this->_out += ')';
+                    break;
+                case 3:
+                    fmt::format_to(std::back_inserter(this->_out), "string: s{} = \"{:a>{}}\"", index, "", this->_opts.string_length);
+                    break;
+            }
+            this->_out += ";\n";
+        }
+
+        // operands are a literal or a single name, so the expression parser stays out of the way
+        void mixed_statement(std::size_t index)
+        {
+            if (index % 2 == 0)
+            {
+                auto name = fmt::format("v{}", index);
+                fmt::format_to(std::back_inserter(this->_out), "    i32: {} = {};\n", name, this->pick(100000));
+                this->_vars.push_back(std::move(name));
+            }
+            else fmt::format_to(std::back_inserter(this->_out), "    sink({}, a);\n", this->_vars.back());
+        }
+
+        public:
+        explicit corpus(const corpus_options &opts) : _opts { opts }, _rng { opts.seed }, _out { }, _vars { } { }
+
+        std::string generate()
+        {
+            if (this->_opts.statement_mix)
+                this->_out += "fun sink(i32: a, i32: b) { }\n\n";
+
+            for (std::size_t func = 0; func < this->_opts.functions; func++)
+            {
+                this->_vars = { "a", "b" };
+
+                fmt::format_to(std::back_inserter(this->_out), "fun f{}(i32: a, i32: b) -> i32\n{{\n", func);
+                for (std::size_t i = 0; i < this->_opts.statements; i++)
+                {
+                    if (this->_opts.statement_mix)
+                        this->mixed_statement(i);
+                    else
+                        this->statement(func, i);
+                }
+
+                this->_out += "    return ";
+                if (this->_opts.statement_mix)
+                    this->_out += "a";
+                else
+                    this->expression(this->_opts.depth);
+                this->_out += ";\n}\n\n";
+            }
+            return std::move(this->_out);
+        }
+    };
+} // namespace bench
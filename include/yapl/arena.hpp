@@ -0,0 +1,119 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <new>
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace yapl
+{
+    // bump allocator, everything is released at once when the arena is destroyed
+    // objects created with make() get their destructors run then, in reverse order
+    struct arena
+    {
+        private:
+        static constexpr std::size_t chunk_size = 64 * 1024;
+
+        struct finaliser
+        {
+            void (*destroy)(void *);
+            void *object;
+            finaliser *next;
+        };
+
+        std::vector<std::unique_ptr<std::byte[]>> _chunks;
+        std::byte *_ptr;
+        std::size_t _left;
+
+        finaliser *_finalisers;
+
+        void finalise()
+        {
+            for (auto node = std::exchange(this->_finalisers, nullptr); node != nullptr; node = node->next)
+                node->destroy(node->object);
+        }
+
+        public:
+        arena() : _chunks { }, _ptr { nullptr }, _left { 0 }, _finalisers { nullptr } { }
+
+        arena(const arena &) = delete;
+        arena &operator=(const arena &) = delete;
+
+        arena(arena &&other) noexcept :
+            _chunks { std::move(other._chunks) }, _ptr { std::exchange(other._ptr, nullptr) },
+            _left { std::exchange(other._left, 0) }, _finalisers { std::exchange(other._finalisers, nullptr) } { }
+
+        arena &operator=(arena &&other) noexcept
+        {
+            if (this != &other)
+            {
+                this->finalise();
+
+                this->_chunks = std::move(other._chunks);
+                this->_ptr = std::exchange(other._ptr, nullptr);
+                this->_left = std::exchange(other._left, 0);
+                this->_finalisers = std::exchange(other._finalisers, nullptr);
+            }
+            return *this;
+        }
+
+        ~arena()
+        {
+            this->finalise();
+        }
+
+        void *allocate(std::size_t size, std::size_t align = alignof(std::max_align_t))
+        {
+            auto pad = -reinterpret_cast<std::uintptr_t>(this->_ptr) & (align - 1);
+            if (this->_ptr == nullptr || pad + size > this->_left)
+            {
+                auto csize = std::max(chunk_size, size + align);
+                auto &chunk = this->_chunks.emplace_back(new std::byte[csize]);
+
+                this->_ptr = chunk.get();
+                this->_left = csize;
+                pad = -reinterpret_cast<std::uintptr_t>(this->_ptr) & (align - 1);
+            }
+
+            auto ret = this->_ptr + pad;
+            this->_ptr += pad + size;
+            this->_left -= pad + size;
+            return ret;
+        }
+
+        char *allocate_chars(std::size_t size)
+        {
+            return static_cast<char *>(this->allocate(size, 1));
+        }
+
+        template<typename Type, typename ...Args>
+        Type *make(Args &&...args)
+        {
+            auto ptr = new (this->allocate(sizeof(Type), alignof(Type))) Type(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<Type>)
+            {
+                this->_finalisers = new (this->allocate(sizeof(finaliser), alignof(finaliser))) finaliser {
+                    [](void *object) { static_cast<Type *>(object)->~Type(); },
+                    ptr, this->_finalisers
+                };
+            }
+            return ptr;
+        }
+
+        std::string_view store(std::string_view str)
+        {
+            auto ptr = this->allocate_chars(str.size());
+            std::memcpy(ptr, str.data(), str.size());
+            return { ptr, str.size() };
+        }
+    };
+} // namespace yapl
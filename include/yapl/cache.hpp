@@ -0,0 +1,42 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <llvm/Support/MemoryBuffer.h>
+#include <yapl/yapl.hpp>
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include <cstdint>
+
+namespace yapl
+{
+    // content addressed store of compiled outputs, one file per key
+    // entries are never invalidated, anything that changes the output is part of the key instead
+    struct cache
+    {
+        private:
+        std::filesystem::path _dir;
+
+        std::filesystem::path entry(std::uint64_t key) const;
+
+        public:
+        explicit cache(std::filesystem::path dir);
+
+        // name is the module identifier, which ends up in the output as well
+        // incremental output is optimised one function at a time, so it differs from a whole module's
+        static std::uint64_t key(std::string_view name, std::string_view source, std::string_view target, opt_level level, std::string_view cpu, std::string_view features, emit_kind kind, bool incremental);
+
+        // copies the output stored for key to path, false on a miss
+        bool fetch(std::uint64_t key, const std::filesystem::path &path) const;
+
+        // best effort, a failed store only costs the next run a compile
+        void store(std::uint64_t key, const std::filesystem::path &path) const;
+
+        // in memory variants, nullptr on a miss
+        std::unique_ptr<llvm::MemoryBuffer> load(std::uint64_t key) const;
+        void save(std::uint64_t key, llvm::StringRef data) const;
+    };
+} // namespace yapl
@@ -0,0 +1,20 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <yapl/lexer.hpp>
+
+#include <cstdio>
+
+namespace yapl::lexer
+{
+    // token streams of a whole tokenise()d unit, for tools outside the compiler
+    // both return false if writing to out failed
+
+    // one "line:column: 'lexeme' : type" line per token
+    bool dump_text(const tokeniser &toker, std::FILE *out);
+
+    // "YTOK", a version byte and the token count as a varint, then per token its
+    // type byte, the varint distance from the end of the previous token and the varint length
+    bool dump_binary(const tokeniser &toker, std::FILE *out);
+} // namespace yapl::lexer
@@ -2,8 +2,14 @@
 
 #pragma once
 
-#include <fstream>
-#include <deque>
+#include <yapl/source.hpp>
+#include <yapl/arena.hpp>
+
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <memory>
 
 #include <string_view>
 #include <string>
@@ -98,66 +104,144 @@ namespace yapl::lexer
         other
     };
 
+    struct location
+    {
+        std::size_t line;
+        std::size_t column;
+    };
+
+    // decoded once by the lexer, nothing downstream parses number text again
+    using number_value = std::variant<std::uint64_t, double>;
+
+    // name points either into the source buffer or, for strings with
+    // escape sequences, into the tokeniser's string arena
     struct token
     {
-        std::string name;
+        std::string_view name;
         token_type type;
+        std::uint32_t offset;
 
-        std::size_t line;
-        std::size_t column;
+        // only meaningful for numbers
+        number_value value;
+    };
+
+    // struct-of-arrays token stream, offset and length describe the raw
+    // lexeme in the source buffer (quotes included for strings)
+    struct token_table
+    {
+        std::vector<token_type> types;
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> lengths;
+
+        // decoded strings with escape sequences and values of numbers, sorted by token index
+        std::vector<std::pair<std::uint32_t, std::string_view>> escaped;
+        std::vector<std::pair<std::uint32_t, number_value>> numbers;
+
+        std::size_t size() const
+        {
+            return this->types.size();
+        }
+
+        void reserve(std::size_t n)
+        {
+            this->types.reserve(n);
+            this->offsets.reserve(n);
+            this->lengths.reserve(n);
+        }
+
+        void push(token_type type, std::uint32_t offset, std::uint32_t length)
+        {
+            this->types.push_back(type);
+            this->offsets.push_back(offset);
+            this->lengths.push_back(length);
+        }
     };
 
     struct tokeniser
     {
-        using stream_type = std::ifstream;
+        // position in the token stream, restoring it is just an index copy
+        struct checkpoint
+        {
+            std::size_t index;
+        };
 
         private:
-        inline static std::size_t ids = 0;
+        std::shared_ptr<const source> _source;
+        arena _strings;
+        const char *_cursor;
 
-        mutable stream_type _stream;
-        mutable std::deque<token> _peek_queue;
+        // tokens are appended on demand by get() and peek(), or all at once by tokenise()
+        token_table _table;
+        std::size_t _index;
 
-        std::size_t _line;
-        std::size_t _column;
-
-        std::string _filename;
-        std::size_t _id;
+        // offsets of line starts, only built once a location is asked for
+        mutable std::vector<std::uint32_t> _lines;
 
         int peekc();
         int getc();
 
-        token next();
+        std::uint32_t offset(const char *ptr) const
+        {
+            return static_cast<std::uint32_t>(ptr - this->_source->begin());
+        }
 
-        public:
-        tokeniser(std::string filename) :
-            _stream { filename }, _peek_queue { }, _line { 0 }, _column { 0 },
-            _filename { filename }, _id { ids++ } { }
+        void push(token_type type, const char *start);
+        void lex_number(const char *start);
+        void next();
 
-        tokeniser(const tokeniser &other) :
-            _stream { other._filename }, _peek_queue { other._peek_queue }, _line { other._line },
-            _column { other._column }, _filename { other._filename }, _id { other._id }
-        {
-            this->_stream.seekg(other._stream.tellg());
-        };
+        // make sure token at index exists, returns false if eof comes first
+        bool fill(std::size_t index);
+        token at(std::size_t index) const;
 
-        tokeniser &operator=(const tokeniser &other)
+        public:
+        explicit tokeniser(std::shared_ptr<const source> src) :
+            _source { std::move(src) }, _strings { }, _cursor { this->_source->begin() },
+            _table { }, _index { 0 }, _lines { }
         {
-            assert(this->_id == other._id);
+            if (this->_source->size() >= UINT32_MAX)
+                throw std::length_error("Source files larger than 4 GiB are not supported");
+        }
 
-            this->_stream.seekg(other._stream.tellg());
-            this->_peek_queue.swap(other._peek_queue);
+        explicit tokeniser(std::string filename) :
+            tokeniser { std::make_shared<const source>(std::move(filename)) } { }
 
-            this->_column = other._column;
-            this->_line = other._line;
+        // in-memory compilation, no file is touched
+        tokeniser(std::string filename, std::string contents) :
+            tokeniser { std::make_shared<const source>(std::move(filename), std::move(contents)) } { }
 
-            return *this;
-        }
+        tokeniser(const tokeniser &) = delete;
+        tokeniser &operator=(const tokeniser &) = delete;
 
         tokeniser(tokeniser &&) = default;
         tokeniser &operator=(tokeniser &&) = default;
 
         ~tokeniser() = default;
 
+        // lex the whole translation unit up front
+        void tokenise();
+
+        const token_table &tokens() const
+        {
+            return this->_table;
+        }
+
+        location locate(std::uint32_t offset) const;
+        location locate(const token &tok) const
+        {
+            return this->locate(tok.offset);
+        }
+
+        checkpoint save() const
+        {
+            return { this->_index };
+        }
+
+        void rewind(checkpoint cp)
+        {
+            assert(cp.index <= this->_table.size());
+            this->_index = cp.index;
+        }
+
         token peek(std::size_t n = 1);
         token get();
 
@@ -168,16 +252,12 @@ namespace yapl::lexer
 
         std::string_view filename() const
         {
-            return this->_filename;
+            return this->_source->name();
         }
 
-        std::size_t line() const
-        {
-            return this->_line + 1;
-        }
-        std::size_t column() const
+        const source &src() const
         {
-            return this->_column - 1;
+            return *this->_source;
         }
     };
 } // namespace yapl::lexer
\ No newline at end of file
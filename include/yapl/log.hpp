@@ -2,15 +2,23 @@
 
 #pragma once
 
-#include <fmt/color.h>
+#include <fmt/format.h>
 
+#include <type_traits>
 #include <exception>
+#include <iterator>
+#include <utility>
+#include <variant>
+#include <memory>
+#include <vector>
+#include <tuple>
 
 #include <string_view>
 #include <string>
 
 #include <cstdint>
 #include <cstddef>
+#include <cstdio>
 
 namespace yapl::log
 {
@@ -21,51 +29,97 @@ namespace yapl::log
         error
     };
 
-    consteval auto level2str(level lvl)
+    constexpr std::string_view level2str(level lvl, bool colour = true)
     {
         switch (lvl)
         {
             case level::note:
-                return "\033[1m\033[90mnote:\033[0m"; // bright black
+                return colour ? "\033[1m\033[90mnote:\033[0m" : "note:"; // bright black
             case level::warning:
-                return "\033[1m\033[35mwarning:\033[0m"; // magenta
+                return colour ? "\033[1m\033[35mwarning:\033[0m" : "warning:"; // magenta
             case level::error:
-                return "\033[1m\033[31merror:\033[0m"; // red
+                return colour ? "\033[1m\033[31merror:\033[0m" : "error:"; // red
             default:
                 __builtin_unreachable();
         }
     }
 
+    // off for anything that isn't a terminal, or when NO_COLOR is set
+    bool colours(std::FILE *file);
+
+    // "prefix level: message", bold and coloured if colour is set
+    void render(std::string &out, std::string_view prefix, level lvl, std::string_view message, bool colour);
+
     template<level lvl = level::note, typename ...Args>
     void println(fmt::format_string<Args...> msg, Args &&...args) noexcept
     {
-        fmt::println(lvl == level::error ? stderr : stdout, "{}",
-            fmt::format(fmt::emphasis::bold, "{} {}", level2str(lvl),
-                fmt::styled(
-                    fmt::format(msg, std::forward<Args>(args)...),
-                    fmt::emphasis::bold
-                )
-            )
-        );
+        auto file = (lvl == level::error) ? stderr : stdout;
+
+        std::string out;
+        render(out, "", lvl, fmt::format(msg, std::forward<Args>(args)...), colours(file));
+        out += '\n';
+        std::fputs(out.c_str(), file);
     }
 
+    namespace detail
+    {
+        // what an error keeps of an argument. strings are copied, they usually point
+        // into a source or another exception that's gone by the time anything is printed
+        template<typename Type>
+        using captured = std::conditional_t<
+            std::is_convertible_v<const std::decay_t<Type> &, std::string_view>,
+            std::string, std::decay_t<Type>
+        >;
+
+        struct payload
+        {
+            std::string file;
+            // line 0 if the error isn't tied to a position
+            std::size_t line;
+            std::size_t column;
+
+            payload(std::string_view file, std::size_t line, std::size_t column) :
+                file { file }, line { line }, column { column } { }
+
+            virtual ~payload() = default;
+            virtual void message(std::string &out) const = 0;
+        };
+
+        template<typename ...Args>
+        struct bound final : payload
+        {
+            fmt::string_view format;
+            std::tuple<Args...> args;
+
+            template<typename ...Params>
+            bound(std::string_view file, std::size_t line, std::size_t column, fmt::string_view format, Params &&...params) :
+                payload { file, line, column }, format { format }, args { std::forward<Params>(params)... } { }
+
+            void message(std::string &out) const override
+            {
+                std::apply([&](const auto &...args) {
+                    fmt::vformat_to(std::back_inserter(out), this->format, fmt::make_format_args(args...));
+                }, this->args);
+            }
+        };
+    } // namespace detail
+
+    // only the arguments are captured when thrown, the message is formatted when it's printed
     class error : public std::exception
     {
         private:
-        std::string _msg;
+        std::shared_ptr<const detail::payload> _data;
+        mutable std::string _what;
 
         public:
         template<typename ...Args>
-        error(std::string_view file, std::size_t line, std::size_t column, fmt::format_string<Args...> msg, Args &&...args) noexcept
-            : _msg(
-                fmt::format(fmt::emphasis::bold, "{}:{}:{}: {} {}",
-                    file, line, column, level2str(level::error),
-                    fmt::styled(
-                        fmt::format(msg, std::forward<Args>(args)...),
-                        fmt::emphasis::bold
-                    )
-                )
-            ) { }
+        error(std::string_view file, std::size_t line, std::size_t column, fmt::format_string<Args...> msg, Args &&...args)
+            : _data { std::make_shared<detail::bound<detail::captured<Args>...>>(file, line, column, msg, std::forward<Args>(args)...) }, _what { } { }
+
+        // for errors that aren't tied to a position in the file
+        template<typename ...Args>
+        error(std::string_view file, fmt::format_string<Args...> msg, Args &&...args)
+            : error { file, 0, 0, msg, std::forward<Args>(args)... } { }
 
         error(const error &) = default;
         error(error &&) = default;
@@ -75,11 +129,79 @@ namespace yapl::log
 
         ~error() override = default;
 
-        [[nodiscard]] const char *what() const noexcept override
+        std::string_view file() const
+        {
+            return this->_data->file;
+        }
+
+        std::size_t line() const
+        {
+            return this->_data->line;
+        }
+
+        std::size_t column() const
         {
-            return this->_msg.c_str();
+            return this->_data->column;
         }
+
+        // "file:line:column: error: message"
+        void render(std::string &out, bool colour) const;
+
+        // rendered without colour on first use
+        [[nodiscard]] const char *what() const noexcept override;
     };
 
-    struct empty_error { };
-} // namespace yapl::log
\ No newline at end of file
+    // diagnostics of one unit, kept unrendered until they're flushed in a single write
+    struct sink
+    {
+        private:
+        std::vector<std::variant<error, std::string>> _entries;
+        std::size_t _errors;
+        std::size_t _limit;
+        // an error was turned away, what's printed is incomplete
+        bool _dropped;
+
+        public:
+        // 0 means no limit
+        explicit sink(std::size_t limit = 0) : _entries { }, _errors { 0 }, _limit { limit }, _dropped { false } { }
+
+        // false if the limit had already been reached and err was dropped, whoever is reporting should give up then
+        bool report(error err);
+
+        // records the exception being handled, call from a catch block
+        // anything that isn't an error is attributed to file
+        bool report_current(std::string_view file);
+
+        // printed as is, for reports that aren't errors
+        void append(std::string text);
+
+        // errors in source order, stable so errors without a position keep theirs
+        // relative to each other after the positioned ones. text stays last
+        void sort();
+
+        std::size_t errors() const
+        {
+            return this->_errors;
+        }
+
+        bool full() const
+        {
+            return this->_limit != 0 && this->_errors >= this->_limit;
+        }
+
+        bool dropped() const
+        {
+            return this->_dropped;
+        }
+
+        bool empty() const
+        {
+            return this->_entries.empty();
+        }
+
+        std::string render(bool colour) const;
+
+        // colours follow the file, see colours()
+        void flush(std::FILE *file);
+    };
+} // namespace yapl::log
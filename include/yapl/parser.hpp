@@ -2,13 +2,21 @@
 
 #pragma once
 
+#include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
 
+#include <yapl/symbols.hpp>
 #include <yapl/lexer.hpp>
+#include <yapl/log.hpp>
 
 #include <string_view>
 #include <string>
 
+#include <unordered_map>
+#include <stdexcept>
+#include <optional>
+#include <utility>
 #include <variant>
 #include <vector>
 #include <memory>
@@ -27,26 +35,94 @@ namespace yapl::ast
         template<typename ...Types>
         struct overloads : Types... { using Types::operator()...; };
 
+        // outcome of a speculative parse, empty if the tokens didn't match
+        // real errors are still reported by throwing log::error
+        template<typename Type>
+        using result = std::optional<Type>;
+
         enum class num_size : std::uint8_t
         {
             i8, i16, i32, i64, f32, f64
         };
+
+        // a codegen error at offset in the source
+        struct codegen_error : std::runtime_error
+        {
+            std::uint32_t offset;
+
+            codegen_error(std::uint32_t offset, const std::string &message) :
+                std::runtime_error { message }, offset { offset } { }
+        };
+
+        // convert() and arith() don't know where they are, a node puts their errors at its own offset
+        // errors of nested nodes already have a position and are passed on as they are
+        template<typename Func>
+        decltype(auto) at(std::uint32_t offset, Func &&func)
+        {
+            try {
+                return func();
+            }
+            catch (const codegen_error &)
+            {
+                throw;
+            }
+            catch (const std::runtime_error &e)
+            {
+                throw codegen_error { offset, e.what() };
+            }
+        }
     } // namespace detail
 
+    namespace statements
+    {
+        struct variable;
+    } // namespace statements
+
+    namespace func
+    {
+        struct function;
+    } // namespace func
+
     namespace types
     {
         struct type
         {
+            private:
+            // lowered type, valid for _context only
+            mutable const llvm::LLVMContext *_context = nullptr;
+            mutable llvm::Type *_lowered = nullptr;
+
+            virtual llvm::Type *lower(llvm::IRBuilder<> &builder) const = 0;
+
+            public:
             virtual ~type() = default;
-            virtual llvm::Type *codegen(llvm::IRBuilder<> &builder) const = 0;
+
+            // as it's spelled in the source
+            virtual std::string name() const = 0;
+
+            // lowers once per context, then returns the cached llvm type
+            llvm::Type *codegen(llvm::IRBuilder<> &builder) const
+            {
+                auto &context = builder.getContext();
+                if (this->_context != &context)
+                {
+                    this->_lowered = this->lower(builder);
+                    this->_context = &context;
+                }
+                return this->_lowered;
+            }
         };
 
         struct string : type
         {
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
+            {
+                return llvm::PointerType::get(builder.getInt8Ty(), 0);
+            }
+
+            std::string name() const override
             {
-                // TODO
-                return nullptr;
+                return "string";
             }
         };
 
@@ -58,7 +134,7 @@ namespace yapl::ast
             number(detail::num_size size, bool is_signed) :
                 size { size }, is_signed { is_signed } { }
 
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
             {
                 switch (this->size)
                 {
@@ -78,22 +154,53 @@ namespace yapl::ast
                         return nullptr;
                 }
             }
+
+            std::string name() const override
+            {
+                switch (this->size)
+                {
+                    case detail::num_size::i8:
+                        return this->is_signed ? "i8" : "u8";
+                    case detail::num_size::i16:
+                        return this->is_signed ? "i16" : "u16";
+                    case detail::num_size::i32:
+                        return this->is_signed ? "i32" : "u32";
+                    case detail::num_size::i64:
+                        return this->is_signed ? "i64" : "u64";
+                    case detail::num_size::f32:
+                        return "f32";
+                    case detail::num_size::f64:
+                        return "f64";
+                    default:
+                        return "";
+                }
+            }
         };
 
         struct boolean : type
         {
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
             {
                 return builder.getInt1Ty();
             }
+
+            std::string name() const override
+            {
+                return "bool";
+            }
         };
 
         struct void_type : type
         {
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
             {
                 return builder.getVoidTy();
             }
+
+            std::string name() const override
+            {
+                return "void";
+            }
         };
 
         struct pointer : type
@@ -102,10 +209,15 @@ namespace yapl::ast
 
             explicit pointer(const type *tp) : tp { tp } { }
 
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
             {
                 return llvm::PointerType::get(this->tp->codegen(builder), 0);
             }
+
+            std::string name() const override
+            {
+                return this->tp->name() + "[]";
+            }
         };
 
         struct array : type
@@ -116,28 +228,281 @@ namespace yapl::ast
             array(const type *tp, std::size_t size) :
                 tp { tp }, size { size } { }
 
-            llvm::Type *codegen(llvm::IRBuilder<> &builder) const override
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
             {
                 return llvm::ArrayType::get(this->tp->codegen(builder), this->size);
             }
+
+            std::string name() const override
+            {
+                return fmt::format("{}[{}]", this->tp->name(), this->size);
+            }
+        };
+
+        struct tuple : type
+        {
+            std::vector<const type *> elements;
+
+            explicit tuple(std::vector<const type *> elements) :
+                elements { std::move(elements) } { }
+
+            llvm::Type *lower(llvm::IRBuilder<> &builder) const override
+            {
+                std::vector<llvm::Type *> types;
+                for (auto element : this->elements)
+                    types.push_back(element->codegen(builder));
+
+                return llvm::StructType::get(builder.getContext(), types);
+            }
+
+            std::string name() const override
+            {
+                std::string ret = "(";
+                for (std::size_t i = 0; auto element : this->elements)
+                {
+                    if (i++ > 0)
+                        ret += ", ";
+                    ret += element->name();
+                }
+                return ret + ")";
+            }
         };
+
+        // void only stands alone as a return type
+        inline bool is_void(const type *tp)
+        {
+            return dynamic_cast<const void_type *>(tp) != nullptr;
+        }
+
+        // how integers of a type extend, divide and compare
+        // bool zero extends like an unsigned type
+        inline bool is_signed(const type *tp)
+        {
+            if (auto num = dynamic_cast<const number *>(tp))
+                return num->is_signed;
+            return dynamic_cast<const boolean *>(tp) == nullptr;
+        }
     } // namespace types
 
+    namespace detail
+    {
+        // llvm integers have no sign, so values travel with the type they are read as
+        struct operand
+        {
+            llvm::Value *value;
+            const types::type *type;
+
+            bool is_signed() const
+            {
+                return types::is_signed(this->type);
+            }
+        };
+
+        // implicit conversions between scalars, nullptr if there's none
+        // integers extend by the signedness of the source, bool always zero extends
+        inline llvm::Value *cast(llvm::IRBuilder<> &builder, operand from, llvm::Type *to, bool to_signed)
+        {
+            auto value = from.value;
+            auto type = value->getType();
+            if (type == to)
+                return value;
+
+            auto is_signed = from.is_signed() && !type->isIntegerTy(1);
+
+            if (type->isIntegerTy() && to->isIntegerTy(1))
+                return builder.CreateICmpNE(value, llvm::ConstantInt::get(type, 0));
+            if (type->isFloatingPointTy() && to->isIntegerTy(1))
+                return builder.CreateFCmpUNE(value, llvm::ConstantFP::get(type, 0.0));
+
+            if (type->isIntegerTy() && to->isIntegerTy())
+                return is_signed ? builder.CreateSExtOrTrunc(value, to) : builder.CreateZExtOrTrunc(value, to);
+            if (type->isIntegerTy() && to->isFloatingPointTy())
+                return is_signed ? builder.CreateSIToFP(value, to) : builder.CreateUIToFP(value, to);
+            if (type->isFloatingPointTy() && to->isIntegerTy())
+                return to_signed ? builder.CreateFPToSI(value, to) : builder.CreateFPToUI(value, to);
+            if (type->isFloatingPointTy() && to->isFloatingPointTy())
+                return builder.CreateFPCast(value, to);
+            if (type->isPointerTy() && to->isPointerTy())
+                return builder.CreatePointerCast(value, to);
+
+            return nullptr;
+        }
+
+        inline llvm::Value *convert(llvm::IRBuilder<> &builder, operand from, const types::type *to)
+        {
+            if (auto ret = cast(builder, from, to->codegen(builder), types::is_signed(to)))
+                return ret;
+            throw std::runtime_error(fmt::format("Cannot convert '{}' to '{}'", from.type->name(), to->name()));
+        }
+
+        inline llvm::Value *to_bool(llvm::IRBuilder<> &builder, operand from)
+        {
+            if (auto ret = cast(builder, from, builder.getInt1Ty(), false))
+                return ret;
+            throw std::runtime_error(fmt::format("Cannot convert '{}' to 'bool'", from.type->name()));
+        }
+
+        // brings both operands to a common type: floating point wins over integers, then the wider one
+        // a literal takes the type of the other side if both are integers or both are floats, so x + 1 stays an i32
+        // integers of the same width are unsigned if either side is. comparisons give boolean
+        inline operand arith(llvm::IRBuilder<> &builder, lexer::token_type op, operand left, operand right, const types::type *boolean)
+        {
+            auto ltype = left.value->getType();
+            auto rtype = right.value->getType();
+
+            // anything else would make invalid ir
+            auto scalar = [](llvm::Type *type) { return type->isIntegerTy() || type->isFloatingPointTy(); };
+            if (!scalar(ltype) || !scalar(rtype))
+                throw std::runtime_error(fmt::format("Invalid operands '{}' and '{}'", left.type->name(), right.type->name()));
+
+            auto lconst = llvm::isa<llvm::Constant>(left.value);
+            auto rconst = llvm::isa<llvm::Constant>(right.value);
+
+            auto type = left.is_signed() ? right.type : left.type;
+            if (ltype != rtype)
+            {
+                auto same_kind = (ltype->isIntegerTy() && rtype->isIntegerTy()) || (ltype->isFloatingPointTy() && rtype->isFloatingPointTy());
+
+                const operand *common = nullptr;
+                if (same_kind && rconst && !lconst)
+                    common = &left;
+                else if (same_kind && lconst && !rconst)
+                    common = &right;
+                else if (ltype->isFloatingPointTy() || rtype->isFloatingPointTy())
+                {
+                    if (!ltype->isFloatingPointTy())
+                        common = &right;
+                    else if (!rtype->isFloatingPointTy())
+                        common = &left;
+                    else
+                        common = (ltype->getPrimitiveSizeInBits() >= rtype->getPrimitiveSizeInBits()) ? &left : &right;
+                }
+                else common = (ltype->getIntegerBitWidth() >= rtype->getIntegerBitWidth()) ? &left : &right;
+
+                type = common->type;
+
+                left.value = convert(builder, left, type);
+                right.value = convert(builder, right, type);
+            }
+            else if (lconst != rconst)
+                type = lconst ? right.type : left.type;
+
+            auto lhs = left.value;
+            auto rhs = right.value;
+
+            auto fp = lhs->getType()->isFloatingPointTy();
+            auto is_signed = types::is_signed(type);
+            auto integer = [&](const char *name)
+            {
+                if (!lhs->getType()->isIntegerTy())
+                    throw std::runtime_error(fmt::format("Operator '{}' needs integer operands", name));
+            };
+
+            auto cmp = [&](llvm::CmpInst::Predicate fpred, llvm::CmpInst::Predicate spred, llvm::CmpInst::Predicate upred)
+            {
+                if (fp)
+                    return operand { builder.CreateFCmp(fpred, lhs, rhs), boolean };
+                return operand { builder.CreateICmp(is_signed ? spred : upred, lhs, rhs), boolean };
+            };
+
+            switch (op)
+            {
+                case lexer::token_type::add:
+                    return { fp ? builder.CreateFAdd(lhs, rhs) : builder.CreateAdd(lhs, rhs), type };
+                case lexer::token_type::sub:
+                    return { fp ? builder.CreateFSub(lhs, rhs) : builder.CreateSub(lhs, rhs), type };
+                case lexer::token_type::mul:
+                    return { fp ? builder.CreateFMul(lhs, rhs) : builder.CreateMul(lhs, rhs), type };
+                case lexer::token_type::div:
+                    if (fp)
+                        return { builder.CreateFDiv(lhs, rhs), type };
+                    return { is_signed ? builder.CreateSDiv(lhs, rhs) : builder.CreateUDiv(lhs, rhs), type };
+                case lexer::token_type::mod:
+                    if (fp)
+                        return { builder.CreateFRem(lhs, rhs), type };
+                    return { is_signed ? builder.CreateSRem(lhs, rhs) : builder.CreateURem(lhs, rhs), type };
+
+                case lexer::token_type::bw_and:
+                    integer("&");
+                    return { builder.CreateAnd(lhs, rhs), type };
+                case lexer::token_type::bw_or:
+                    integer("|");
+                    return { builder.CreateOr(lhs, rhs), type };
+                case lexer::token_type::bw_xor:
+                    integer("^");
+                    return { builder.CreateXor(lhs, rhs), type };
+                case lexer::token_type::shiftl:
+                    integer("<<");
+                    return { builder.CreateShl(lhs, rhs), type };
+                case lexer::token_type::shiftr:
+                    integer(">>");
+                    return { is_signed ? builder.CreateAShr(lhs, rhs) : builder.CreateLShr(lhs, rhs), type };
+
+                // && and || short-circuit, expressions::binaryop emits those
+                case lexer::token_type::log_xor:
+                    return { builder.CreateXor(to_bool(builder, left), to_bool(builder, right)), boolean };
+
+                case lexer::token_type::eq:
+                    return cmp(llvm::CmpInst::FCMP_OEQ, llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_EQ);
+                case lexer::token_type::ne:
+                    return cmp(llvm::CmpInst::FCMP_UNE, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_NE);
+                case lexer::token_type::lt:
+                    return cmp(llvm::CmpInst::FCMP_OLT, llvm::CmpInst::ICMP_SLT, llvm::CmpInst::ICMP_ULT);
+                case lexer::token_type::gt:
+                    return cmp(llvm::CmpInst::FCMP_OGT, llvm::CmpInst::ICMP_SGT, llvm::CmpInst::ICMP_UGT);
+                case lexer::token_type::le:
+                    return cmp(llvm::CmpInst::FCMP_OLE, llvm::CmpInst::ICMP_SLE, llvm::CmpInst::ICMP_ULE);
+                case lexer::token_type::ge:
+                    return cmp(llvm::CmpInst::FCMP_OGE, llvm::CmpInst::ICMP_SGE, llvm::CmpInst::ICMP_UGE);
+
+                default:
+                    throw std::runtime_error("Unsupported binary operator");
+            }
+        }
+    } // namespace detail
+
     namespace expressions
     {
         struct expression
         {
+            // how many levels deep codegen recurses from here, the parser caps it
+            std::uint32_t depth = 1;
+
             virtual ~expression() = default;
             virtual llvm::Value *codegen(llvm::IRBuilder<> &builder) = 0;
+
+            // what the value is read as, valid once codegen has run
+            virtual const types::type *type() const = 0;
+
+            // storage and type of assignable expressions, the parser only lets those be assigned to
+            virtual std::pair<llvm::Value *, llvm::Type *> address(llvm::IRBuilder<> &builder)
+            {
+                return { nullptr, nullptr };
+            }
         };
 
-        struct boolean : expression
+        // literals are typed by the parser, numbers as i64 or f64
+        struct literal : expression
+        {
+            private:
+            const types::type *_type;
+
+            public:
+            explicit literal(const types::type *type) : _type { type } { }
+
+            const types::type *type() const override
+            {
+                return this->_type;
+            }
+        };
+
+        struct boolean : literal
         {
             private:
             bool value;
 
             public:
-            explicit boolean(bool value) : value(value) { }
+            boolean(bool value, const types::type *type) : literal { type }, value(value) { }
 
             llvm::Value *codegen(llvm::IRBuilder<> &builder) override
             {
@@ -145,14 +510,15 @@ namespace yapl::ast
             }
         };
 
-        struct number : expression
+        struct number : literal
         {
             private:
             std::variant<std::uint64_t, double> value;
 
             public:
-            explicit number(std::uint64_t value) : value { value } { }
-            explicit number(double value) : value { value } { }
+            number(std::uint64_t value, const types::type *type) : literal { type }, value { value } { }
+            number(double value, const types::type *type) : literal { type }, value { value } { }
+            number(lexer::number_value value, const types::type *type) : literal { type }, value { value } { }
 
             llvm::Value *codegen(llvm::IRBuilder<> &builder) override
             {
@@ -169,133 +535,294 @@ namespace yapl::ast
             }
         };
 
-        struct string : expression
+        struct string : literal
         {
             private:
             std::string value;
 
             public:
-            explicit string(std::string_view value) : value { value } { }
+            string(std::string_view value, const types::type *type) : literal { type }, value { value } { }
 
             llvm::Value *codegen(llvm::IRBuilder<> &builder) override
             {
-                return llvm::ConstantDataArray::getString(builder.getContext(), this->value);
+                return builder.CreateGlobalString(this->value);
             }
         };
 
-        struct binaryop : expression
+        struct identifier : expression
         {
             private:
-            lexer::token_type op;
-            std::shared_ptr<expression> left;
-            std::shared_ptr<expression> right;
+            statements::variable *var;
 
             public:
-            binaryop(lexer::token_type op, std::shared_ptr<expression> left, std::shared_ptr<expression> right) :
-                op { op }, left { left }, right { right } { }
+            explicit identifier(statements::variable *var) : var { var } { }
+
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override;
+            const types::type *type() const override;
+            std::pair<llvm::Value *, llvm::Type *> address(llvm::IRBuilder<> &builder) override;
+        };
+
+        struct call : expression
+        {
+            private:
+            std::vector<expression *> args;
+            std::uint32_t offset;
+
+            llvm::Value *generate(llvm::IRBuilder<> &builder);
+
+            public:
+            std::string name;
+
+            // resolved by the parser once every function of the unit is known
+            func::function *callee = nullptr;
+
+            call(std::string_view name, std::vector<expression *> args, std::uint32_t offset) :
+                args { std::move(args) }, offset { offset }, name { name }
+            {
+                for (auto arg : this->args)
+                    this->depth = std::max(this->depth, arg->depth + 1);
+            }
 
             llvm::Value *codegen(llvm::IRBuilder<> &builder) override
             {
-                auto leftValue = left->codegen(builder);
-                auto rightValue = right->codegen(builder);
+                return detail::at(this->offset, [&] { return this->generate(builder); });
+            }
 
-                if (!leftValue || !rightValue)
-                    return nullptr;
+            const types::type *type() const override;
+        };
 
-                switch (op)
+        struct unaryop : expression
+        {
+            private:
+            lexer::token_type op;
+            expression *operand;
+            std::uint32_t offset;
+
+            // of !, the others keep the operand's type
+            const types::type *boolean;
+
+            llvm::Value *generate(llvm::IRBuilder<> &builder)
+            {
+                if (this->op == lexer::token_type::inc || this->op == lexer::token_type::dec)
                 {
-                    case lexer::token_type::inc:
-                        return builder.CreateAdd(leftValue, llvm::ConstantInt::get(leftValue->getType(), 1));
-                    case lexer::token_type::dec:
-                        return builder.CreateSub(leftValue, llvm::ConstantInt::get(leftValue->getType(), 1));
+                    auto [ptr, type] = this->operand->address(builder);
+                    if (!type->isIntegerTy() && !type->isFloatingPointTy())
+                        throw std::runtime_error(fmt::format("Operator '{}' needs a number operand", this->op == lexer::token_type::inc ? "++" : "--"));
 
-                    case lexer::token_type::add:
-                        return builder.CreateAdd(leftValue, rightValue);
-                    case lexer::token_type::add_assign:
-                        return builder.CreateStore(builder.CreateAdd(leftValue, rightValue), leftValue);
+                    auto value = builder.CreateLoad(type, ptr);
+
+                    auto one = type->isFloatingPointTy() ? llvm::ConstantFP::get(type, 1.0) : llvm::ConstantInt::get(type, 1);
+                    auto vtype = this->operand->type();
+                    auto res = detail::arith(builder, this->op == lexer::token_type::inc ? lexer::token_type::add : lexer::token_type::sub, { value, vtype }, { one, vtype }, this->boolean).value;
+
+                    builder.CreateStore(res, ptr);
+                    return res;
+                }
+
+                auto value = this->operand->codegen(builder);
+                auto type = value->getType();
 
+                switch (this->op)
+                {
                     case lexer::token_type::sub:
-                        return builder.CreateSub(leftValue, rightValue);
-                    case lexer::token_type::sub_assign:
-                        return builder.CreateStore(builder.CreateSub(leftValue, rightValue), leftValue);
+                        if (!type->isIntegerTy() && !type->isFloatingPointTy())
+                            throw std::runtime_error("Operator '-' needs a number operand");
+                        return type->isFloatingPointTy() ? builder.CreateFNeg(value) : builder.CreateNeg(value);
+
+                    case lexer::token_type::bw_not:
+                        if (!type->isIntegerTy())
+                            throw std::runtime_error("Operator '~' needs an integer operand");
+                        return builder.CreateNot(value);
+                    case lexer::token_type::log_not:
+                        return builder.CreateNot(detail::to_bool(builder, { value, this->operand->type() }));
 
-                    case lexer::token_type::mul:
-                        return builder.CreateMul(leftValue, rightValue);
-                    case lexer::token_type::mul_assign:
-                        return builder.CreateStore(builder.CreateMul(leftValue, rightValue), leftValue);
+                    default:
+                        throw std::runtime_error("Unsupported unary operator");
+                }
+            }
 
-                    case lexer::token_type::div:
-                        return builder.CreateSDiv(leftValue, rightValue);
-                    case lexer::token_type::div_assign:
-                        return builder.CreateStore(builder.CreateSDiv(leftValue, rightValue), leftValue);
+            public:
+            unaryop(lexer::token_type op, expression *operand, std::uint32_t offset, const types::type *boolean) :
+                op { op }, operand { operand }, offset { offset }, boolean { boolean }
+            {
+                this->depth = operand->depth + 1;
+            }
 
-                    case lexer::token_type::mod:
-                        return builder.CreateSRem(leftValue, rightValue);
-                    case lexer::token_type::mod_assign:
-                        return builder.CreateStore(builder.CreateSRem(leftValue, rightValue), leftValue);
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override
+            {
+                return detail::at(this->offset, [&] { return this->generate(builder); });
+            }
 
-                    case lexer::token_type::bw_and:
-                        return builder.CreateAnd(leftValue, rightValue);
-                    case lexer::token_type::bw_and_assign:
-                        return builder.CreateStore(builder.CreateAnd(leftValue, rightValue), leftValue);
+            const types::type *type() const override
+            {
+                return (this->op == lexer::token_type::log_not) ? this->boolean : this->operand->type();
+            }
+        };
 
-                    case lexer::token_type::bw_or:
-                        return builder.CreateOr(leftValue, rightValue);
-                    case lexer::token_type::bw_or_assign:
-                        return builder.CreateStore(builder.CreateOr(leftValue, rightValue), leftValue);
+        struct binaryop : expression
+        {
+            private:
+            lexer::token_type op;
+            expression *left;
+            expression *right;
+            std::uint32_t offset;
 
-                    case lexer::token_type::bw_xor:
-                        return builder.CreateXor(leftValue, rightValue);
-                    case lexer::token_type::bw_xor_assign:
-                        return builder.CreateStore(builder.CreateXor(leftValue, rightValue), leftValue);
+            // of comparisons and logical operators
+            const types::type *boolean;
 
-                    case lexer::token_type::shiftl:
-                        return builder.CreateShl(leftValue, rightValue);
-                    case lexer::token_type::shiftl_assign:
-                        return builder.CreateStore(builder.CreateShl(leftValue, rightValue), leftValue);
+            // set by codegen from the operands
+            const types::type *_type = nullptr;
 
-                    case lexer::token_type::shiftr:
-                        return builder.CreateAShr(leftValue, rightValue);
+            // op of a compound assignment, or eof for anything else
+            static constexpr lexer::token_type compound(lexer::token_type op)
+            {
+                switch (op)
+                {
+                    case lexer::token_type::add_assign:
+                        return lexer::token_type::add;
+                    case lexer::token_type::sub_assign:
+                        return lexer::token_type::sub;
+                    case lexer::token_type::mul_assign:
+                        return lexer::token_type::mul;
+                    case lexer::token_type::div_assign:
+                        return lexer::token_type::div;
+                    case lexer::token_type::mod_assign:
+                        return lexer::token_type::mod;
+                    case lexer::token_type::bw_and_assign:
+                        return lexer::token_type::bw_and;
+                    case lexer::token_type::bw_or_assign:
+                        return lexer::token_type::bw_or;
+                    case lexer::token_type::bw_xor_assign:
+                        return lexer::token_type::bw_xor;
+                    case lexer::token_type::shiftl_assign:
+                        return lexer::token_type::shiftl;
                     case lexer::token_type::shiftr_assign:
-                        return builder.CreateStore(builder.CreateAShr(leftValue, rightValue), leftValue);
+                        return lexer::token_type::shiftr;
+                    case lexer::token_type::log_and_assign:
+                        return lexer::token_type::log_and;
+                    case lexer::token_type::log_or_assign:
+                        return lexer::token_type::log_or;
+                    case lexer::token_type::log_xor_assign:
+                        return lexer::token_type::log_xor;
+                    default:
+                        return lexer::token_type::eof;
+                }
+            }
 
-                    case lexer::token_type::assign:
-                        return builder.CreateStore(rightValue, leftValue);
+            // anything but an assignment, a + b + c is generated in a loop rather than by recursing into a + b
+            static constexpr bool chains(lexer::token_type op)
+            {
+                return op != lexer::token_type::assign && compound(op) == lexer::token_type::eof;
+            }
 
-                    case lexer::token_type::log_not:
-                        return builder.CreateNot(leftValue);
+            // && and || only evaluate the right side if the left one doesn't decide the result
+            llvm::Value *short_circuit(llvm::IRBuilder<> &builder, lexer::token_type op, detail::operand left)
+            {
+                auto &context = builder.getContext();
+                auto func = builder.GetInsertBlock()->getParent();
+
+                auto lhs = detail::to_bool(builder, left);
+                auto from = builder.GetInsertBlock();
+
+                auto rhs_block = llvm::BasicBlock::Create(context, "rhs", func);
+                auto end_block = llvm::BasicBlock::Create(context, "end");
+
+                if (op == lexer::token_type::log_and)
+                    builder.CreateCondBr(lhs, rhs_block, end_block);
+                else
+                    builder.CreateCondBr(lhs, end_block, rhs_block);
+
+                builder.SetInsertPoint(rhs_block);
+                auto rhs = detail::to_bool(builder, { this->right->codegen(builder), this->right->type() });
+                // the right side may have added blocks of its own
+                rhs_block = builder.GetInsertBlock();
+                builder.CreateBr(end_block);
+
+                // after the right side's blocks, so the function reads top to bottom
+                end_block->insertInto(func);
+                builder.SetInsertPoint(end_block);
+                auto phi = builder.CreatePHI(builder.getInt1Ty(), 2);
+                phi->addIncoming(builder.getInt1(op == lexer::token_type::log_or), from);
+                phi->addIncoming(rhs, rhs_block);
+                return phi;
+            }
 
-                    case lexer::token_type::log_and:
-                        return builder.CreateAnd(leftValue, rightValue);
-                    case lexer::token_type::log_and_assign:
-                        return builder.CreateStore(builder.CreateAnd(leftValue, rightValue), leftValue);
+            static constexpr bool is_short_circuit(lexer::token_type op)
+            {
+                return op == lexer::token_type::log_and || op == lexer::token_type::log_or;
+            }
 
-                    case lexer::token_type::log_or:
-                        return builder.CreateOr(leftValue, rightValue);
-                    case lexer::token_type::log_or_assign:
-                        return builder.CreateStore(builder.CreateOr(leftValue, rightValue), leftValue);
+            // left op right, for an op that chains
+            detail::operand combine(llvm::IRBuilder<> &builder, detail::operand left)
+            {
+                if (is_short_circuit(this->op))
+                {
+                    this->_type = this->boolean;
+                    return { this->short_circuit(builder, this->op, left), this->_type };
+                }
 
-                    case lexer::token_type::log_xor:
-                        return builder.CreateXor(leftValue, rightValue);
-                    case lexer::token_type::log_xor_assign:
-                        return builder.CreateStore(builder.CreateXor(leftValue, rightValue), leftValue);
-
-                    case lexer::token_type::eq:
-                        return builder.CreateICmpEQ(leftValue, rightValue);
-                    case lexer::token_type::ne:
-                        return builder.CreateICmpNE(leftValue, rightValue);
-                    case lexer::token_type::lt:
-                        return builder.CreateICmpSLT(leftValue, rightValue);
-                    case lexer::token_type::gt:
-                        return builder.CreateICmpSGT(leftValue, rightValue);
-                    case lexer::token_type::le:
-                        return builder.CreateICmpSLE(leftValue, rightValue);
-                    case lexer::token_type::ge:
-                        return builder.CreateICmpSGE(leftValue, rightValue);
+                auto res = detail::arith(builder, this->op, left, { this->right->codegen(builder), this->right->type() }, this->boolean);
+                this->_type = res.type;
+                return res;
+            }
 
-                    default:
-                        return nullptr;
+            llvm::Value *generate(llvm::IRBuilder<> &builder)
+            {
+                if (chains(this->op))
+                {
+                    // the left operands of a chain, outermost first
+                    llvm::SmallVector<binaryop *, 8> chain { this };
+                    while (auto next = dynamic_cast<binaryop *>(chain.back()->left))
+                    {
+                        if (!chains(next->op))
+                            break;
+                        chain.push_back(next);
+                    }
+
+                    auto first = chain.back()->left;
+                    detail::operand value { first->codegen(builder), first->type() };
+                    for (auto node : llvm::reverse(chain))
+                        value = detail::at(node->offset, [&] { return node->combine(builder, value); });
+                    return value.value;
                 }
+
+                auto base = compound(this->op);
+                auto [ptr, type] = this->left->address(builder);
+                this->_type = this->left->type();
+
+                detail::operand value;
+                if (is_short_circuit(base))
+                    value = { this->short_circuit(builder, base, { builder.CreateLoad(type, ptr), this->_type }), this->boolean };
+                else
+                {
+                    value = { this->right->codegen(builder), this->right->type() };
+                    if (base != lexer::token_type::eof)
+                        value = detail::arith(builder, base, { builder.CreateLoad(type, ptr), this->_type }, value, this->boolean);
+                }
+
+                auto res = detail::convert(builder, value, this->_type);
+                builder.CreateStore(res, ptr);
+                return res;
+            }
+
+            public:
+            binaryop(lexer::token_type op, expression *left, expression *right, std::uint32_t offset, const types::type *boolean) :
+                op { op }, left { left }, right { right }, offset { offset }, boolean { boolean }
+            {
+                // the left side of a chain is reached without recursing
+                auto chained = dynamic_cast<binaryop *>(left);
+                auto lnested = (chains(op) && chained != nullptr && chains(chained->op)) ? left->depth : left->depth + 1;
+                this->depth = std::max(lnested, right->depth + 1);
+            }
+
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override
+            {
+                return detail::at(this->offset, [&] { return this->generate(builder); });
+            }
+
+            const types::type *type() const override
+            {
+                return this->_type;
             }
         };
     } // namespace expressions
@@ -305,59 +832,322 @@ namespace yapl::ast
         struct statement
         {
             virtual ~statement() = default;
-            // virtual llvm::Value *codegen(llvm::IRBuilder<> &builder) = 0;
+            virtual llvm::Value *codegen(llvm::IRBuilder<> &builder) = 0;
         };
 
         struct variable : statement
         {
             const types::type *type;
             std::string name;
+            expressions::expression *init;
+
+            // start of the declaration
+            std::uint32_t offset;
 
-            variable(const types::type *type, std::string_view name) :
-                type { type }, name { name } { }
+            // stack slot in the entry block, set by codegen
+            llvm::AllocaInst *storage = nullptr;
+
+            variable(const types::type *type, std::string_view name, std::uint32_t offset, expressions::expression *init = nullptr) :
+                type { type }, name { name }, init { init }, offset { offset } { }
+
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override
+            {
+                auto type = this->type->codegen(builder);
+
+                // allocas go to the entry block so mem2reg can promote them
+                auto &entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+                llvm::IRBuilder<> entry_builder { &entry, entry.begin() };
+                this->storage = entry_builder.CreateAlloca(type, nullptr, this->name);
+
+                if (this->init != nullptr)
+                {
+                    auto value = this->init->codegen(builder);
+                    detail::at(this->offset, [&] {
+                        builder.CreateStore(detail::convert(builder, { value, this->init->type() }, this->type), this->storage);
+                    });
+                }
+
+                return this->storage;
+            }
+        };
+
+        struct expression_statement : statement
+        {
+            expressions::expression *expr;
+
+            explicit expression_statement(expressions::expression *expr) :
+                expr { expr } { }
+
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override
+            {
+                return this->expr->codegen(builder);
+            }
         };
 
         struct return_statement : statement
         {
-            std::unique_ptr<expressions::expression> expr;
+            expressions::expression *expr;
 
-            return_statement(std::unique_ptr<expressions::expression> expr) :
-                expr { std::move(expr) } { }
+            // the function's return type
+            const types::type *type;
+
+            // of the 'return'
+            std::uint32_t offset;
+
+            return_statement(expressions::expression *expr, const types::type *type, std::uint32_t offset) :
+                expr { expr }, type { type }, offset { offset } { }
+
+            llvm::Value *codegen(llvm::IRBuilder<> &builder) override
+            {
+                if (this->expr == nullptr)
+                    return builder.CreateRetVoid();
+
+                auto value = this->expr->codegen(builder);
+                return detail::at(this->offset, [&] {
+                    return builder.CreateRet(detail::convert(builder, { value, this->expr->type() }, this->type));
+                });
+            }
         };
     } // namespace statements
 
+    namespace expressions
+    {
+        inline llvm::Value *identifier::codegen(llvm::IRBuilder<> &builder)
+        {
+            return builder.CreateLoad(this->var->storage->getAllocatedType(), this->var->storage, this->var->name);
+        }
+
+        inline const types::type *identifier::type() const
+        {
+            return this->var->type;
+        }
+
+        inline std::pair<llvm::Value *, llvm::Type *> identifier::address(llvm::IRBuilder<> &builder)
+        {
+            return { this->var->storage, this->var->storage->getAllocatedType() };
+        }
+    } // namespace expressions
+
     namespace func
     {
         struct function
         {
+            private:
+            const llvm::LLVMContext *_context = nullptr;
+            llvm::FunctionType *_type = nullptr;
+
+            public:
             std::string name;
-            std::vector<std::unique_ptr<statements::variable>> params;
+            std::vector<statements::variable *> params;
             const types::type *ret_type;
 
             std::vector<statements::statement *> body;
 
+            // every call in the body, in source order
+            std::vector<expressions::call *> calls;
+
+            // "fun" up to the closing '}', points into the unit's source
+            std::string_view source;
+
+            // of the name
+            std::uint32_t offset;
+
+            // calls a function that didn't parse, so the body can't be checked
+            bool incomplete = false;
+
+            function(std::string name, std::vector<statements::variable *> params, const types::type *ret_type, std::vector<statements::statement *> body, std::string_view source, std::uint32_t offset) :
+                name { std::move(name) }, params { std::move(params) }, ret_type { ret_type }, body { std::move(body) }, source { source }, offset { offset } { }
+
+            // built once per context like types::type::codegen
             llvm::FunctionType *typegen(llvm::IRBuilder<> &builder)
             {
+                if (this->_context == &builder.getContext())
+                    return this->_type;
+
                 std::vector<llvm::Type *> types;
+                types.reserve(this->params.size());
                 for (auto &param : this->params)
                     types.push_back(param->type->codegen(builder));
 
                 auto ret = this->ret_type->codegen(builder);
-                return llvm::FunctionType::get(ret, types, false);
+
+                this->_context = &builder.getContext();
+                return this->_type = llvm::FunctionType::get(ret, types, false);
+            }
+
+            // every function is declared before any body is emitted, so calls can go forward
+            llvm::Function *declare(llvm::IRBuilder<> &builder, llvm::Module &module)
+            {
+                if (module.getFunction(this->name) != nullptr)
+                    throw detail::codegen_error { this->offset, fmt::format("Function '{}' is already defined", this->name) };
+
+                return llvm::Function::Create(this->typegen(builder), llvm::Function::ExternalLinkage, this->name, module);
+            }
+
+            // errors of statements go to report, which returns false to stop at that one
+            // the next statement starts in a new block, nothing is emitted after an error anyway
+            template<typename Report>
+            llvm::Function *codegen(llvm::IRBuilder<> &builder, llvm::Module &module, Report &&report)
+            {
+                auto func = module.getFunction(this->name);
+                builder.SetInsertPoint(llvm::BasicBlock::Create(builder.getContext(), "entry", func));
+
+                for (std::size_t i = 0; auto param : this->params)
+                {
+                    auto arg = func->getArg(i++);
+                    arg->setName(param->name);
+                    builder.CreateStore(arg, param->codegen(builder));
+                }
+
+                for (auto stmt : this->body)
+                {
+                    // anything after a return is unreachable
+                    if (builder.GetInsertBlock()->getTerminator() != nullptr)
+                        break;
+
+                    try {
+                        stmt->codegen(builder);
+                    }
+                    catch (const std::runtime_error &e)
+                    {
+                        if (report(e) == false)
+                            return func;
+                        builder.SetInsertPoint(llvm::BasicBlock::Create(builder.getContext(), "", func));
+                    }
+                }
+
+                if (builder.GetInsertBlock()->getTerminator() == nullptr)
+                {
+                    auto ret = func->getReturnType();
+                    if (ret->isVoidTy())
+                        builder.CreateRetVoid();
+                    else
+                        builder.CreateRet(llvm::Constant::getNullValue(ret));
+                }
+
+                return func;
             }
         };
     } // namespace func
 
+    namespace expressions
+    {
+        inline llvm::Value *call::generate(llvm::IRBuilder<> &builder)
+        {
+            if (this->callee == nullptr)
+                throw std::runtime_error(fmt::format("Function '{}' does not exist", this->name));
+
+            auto &params = this->callee->params;
+            if (params.size() != this->args.size())
+                throw std::runtime_error(fmt::format("Function '{}' takes {} arguments, got {}", this->name, params.size(), this->args.size()));
+
+            auto func = builder.GetInsertBlock()->getModule()->getFunction(this->name);
+
+            std::vector<llvm::Value *> values;
+            for (std::size_t i = 0; i < this->args.size(); i++)
+            {
+                auto value = this->args[i]->codegen(builder);
+                values.push_back(detail::convert(builder, { value, this->args[i]->type() }, params[i]->type));
+            }
+
+            return builder.CreateCall(func, values);
+        }
+
+        inline const types::type *call::type() const
+        {
+            return (this->callee != nullptr) ? this->callee->ret_type : nullptr;
+        }
+    } // namespace expressions
+
     struct parser
     {
         private:
-        const types::type *get_type(std::string_view name, std::size_t array_size = 0) const;
+        // operator stack entry of parse_expression
+        // open_round marks a parenthesis, prec 0 keeps it from being reduced
+        struct pending
+        {
+            lexer::token_type op;
+            std::uint8_t prec;
+            bool unary;
+            std::uint32_t offset;
+        };
+
+        // reused between expressions, so parsing one doesn't allocate
+        std::vector<expressions::expression *> _operands;
+        std::vector<pending> _operators;
+
+        // parse_call, parse_type and codegen recurse once per level, deeper nesting is an error
+        static constexpr std::uint32_t max_depth = 1024;
+
+        // parse_call and parse_type levels currently on the stack
+        std::uint32_t _nesting = 0;
+
+        // counts one level of _nesting for as long as it lives
+        struct nested
+        {
+            std::uint32_t &depth;
+
+            explicit nested(std::uint32_t &depth) : depth { ++depth } { }
+            ~nested() { this->depth--; }
+        };
+
+        // types of literals and conditions, looked up by parse()
+        struct builtins
+        {
+            const types::type *boolean = nullptr;
+            const types::type *integer = nullptr;
+            const types::type *floating = nullptr;
+            const types::type *string = nullptr;
+        };
+        builtins _builtins;
+
+        // numbers are i64 or f64 until an operand or a conversion gives them a type
+        const types::type *literal_type(const lexer::number_value &value) const
+        {
+            return std::holds_alternative<double>(value) ? this->_builtins.floating : this->_builtins.integer;
+        }
+
+        // variables visible in the function being parsed, later declarations shadow earlier ones
+        std::unordered_map<std::string_view, statements::variable *> _scope;
+
+        // calls made by the function being parsed
+        std::vector<expressions::call *> _calls;
+
+        // name of the function being parsed, empty until it's read
+        std::string_view _function;
+
+        // position of the last error, where recovery picks up
+        mutable std::uint32_t _error_offset = 0;
+
+        const types::type *get_type(symbol name) const;
+
+        template<typename ...Args>
+        log::error error(std::uint32_t offset, fmt::format_string<Args...> msg, Args &&...args) const
+        {
+            this->_error_offset = offset;
+            auto [line, column] = this->tokeniser.locate(offset);
+            return log::error(this->tokeniser.filename(), line, column, msg, std::forward<Args>(args)...);
+        }
+
+        template<typename ...Args>
+        log::error error(const lexer::token &tok, fmt::format_string<Args...> msg, Args &&...args) const
+        {
+            return this->error(tok.offset, msg, std::forward<Args>(args)...);
+        }
+
+        // if unknown is set, undefined type names don't fail the parse
+        // the type is nullptr then and unknown gets the first such name
+        detail::result<const types::type *> parse_type(lexer::tokeniser &toker, lexer::token tok, bool should_throw = true, lexer::token *unknown = nullptr);
+        detail::result<std::tuple<std::string_view, const types::type *>> parse_variable(lexer::tokeniser &toker, lexer::token tok, bool should_throw = true);
 
-        std::tuple<std::string, std::size_t> parse_type(lexer::tokeniser &parent_toker, lexer::token tok, bool should_throw = true);
-        std::tuple<std::string, std::string, std::size_t> parse_variable(lexer::tokeniser &parent_toker, lexer::token tok, bool should_throw = true);
+        void reduce(std::uint8_t prec, bool right_assoc, std::size_t floor);
+        expressions::expression *parse_expression(lexer::tokeniser &toker, lexer::token tok);
+        expressions::expression *parse_call(lexer::tokeniser &toker, lexer::token tok);
+        func::function *parse_function(lexer::tokeniser &toker, lexer::token tok);
 
-        std::unique_ptr<expressions::expression> parse_expression(lexer::tokeniser &parent_toker, lexer::token tok, bool should_throw = true);
-        std::unique_ptr<func::function> parse_function(lexer::tokeniser &parent_toker, lexer::token tok, bool should_throw = true);
+        // panic mode, skips from the start of what failed to parse to where parsing can resume
+        // a statement ends after its ';' or before the '}' closing the body, a function before the next 'fun'
+        void synchronise(lexer::tokeniser &toker, lexer::tokeniser::checkpoint from, bool statement);
 
         public:
         lexer::tokeniser &tokeniser;
@@ -366,6 +1156,7 @@ namespace yapl::ast
         parser(lexer::tokeniser &tokeniser, unit &parent) :
             tokeniser { tokeniser }, parent { parent } { }
 
+        // errors go to the unit's diagnostics, parsing goes on after each until the limit
         void parse();
     };
 } // namespace yapl::ast
\ No newline at end of file
@@ -0,0 +1,56 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <yapl/lexer.hpp>
+
+#include <array>
+
+namespace yapl::lexer::scan
+{
+    // same classes as isspace()/ispunct() in the "C" locale, '_' and bytes >= 0x80 are other
+    constexpr auto char_types = []
+    {
+        std::array<char_type, 256> types { };
+        for (std::size_t chr = 0; chr < types.size(); chr++)
+        {
+            if (chr == ' ' || (chr >= '\t' && chr <= '\r'))
+                types[chr] = char_type::space;
+            else if (chr > ' ' && chr < 0x7F && chr != '_' && !(chr >= '0' && chr <= '9') &&
+                     !(chr >= 'a' && chr <= 'z') && !(chr >= 'A' && chr <= 'Z'))
+                types[chr] = char_type::punct;
+            else
+                types[chr] = char_type::other;
+        }
+        return types;
+    } ();
+
+    constexpr char_type classify(int chr)
+    {
+        if (chr == EOF)
+            return char_type::eof;
+
+        return char_types[static_cast<unsigned char>(chr)];
+    }
+
+    // all of these return the first byte in [ptr, end) that doesn't belong to the run, or end
+    // the vector implementation is picked once at startup (AVX2, SSE2 or scalar)
+
+    // whitespace
+    const char *space(const char *ptr, const char *end);
+    // identifier and number characters
+    const char *word(const char *ptr, const char *end);
+    // anything but chr
+    const char *until(const char *ptr, const char *end, char chr);
+
+    // returns the byte after the first "*/", or end
+    inline const char *block_comment(const char *ptr, const char *end)
+    {
+        while ((ptr = until(ptr, end, '*')) != end)
+        {
+            if (++ptr != end && *ptr == '/')
+                return ptr + 1;
+        }
+        return end;
+    }
+} // namespace yapl::lexer::scan
@@ -0,0 +1,57 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <string_view>
+#include <string>
+
+#include <cstddef>
+
+namespace yapl::lexer
+{
+    // whole translation unit in one contiguous read-only buffer
+    // regular files are mmap'd, anything else (pipes, ttys) is read through std::ifstream
+    struct source
+    {
+        private:
+        std::string _name;
+        std::string _storage;
+
+        const char *_data;
+        std::size_t _size;
+        bool _mapped;
+
+        public:
+        explicit source(std::string filename);
+        source(std::string name, std::string contents);
+
+        source(const source &) = delete;
+        source &operator=(const source &) = delete;
+
+        ~source();
+
+        std::string_view name() const
+        {
+            return this->_name;
+        }
+
+        std::string_view text() const
+        {
+            return { this->_data, this->_size };
+        }
+
+        const char *begin() const
+        {
+            return this->_data;
+        }
+        const char *end() const
+        {
+            return this->_data + this->_size;
+        }
+
+        std::size_t size() const
+        {
+            return this->_size;
+        }
+    };
+} // namespace yapl::lexer
@@ -0,0 +1,74 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <yapl/arena.hpp>
+
+#include <unordered_map>
+#include <string_view>
+#include <optional>
+#include <vector>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace yapl
+{
+    // dense id of an interned string, only meaningful to the interner that handed it out
+    enum class symbol : std::uint32_t { };
+
+    constexpr std::size_t index(symbol sym)
+    {
+        return static_cast<std::size_t>(sym);
+    }
+
+    // every distinct string gets the next id, so ids can index flat tables
+    struct interner
+    {
+        private:
+        arena _strings;
+        std::unordered_map<std::string_view, symbol> _ids;
+        std::vector<std::string_view> _names;
+
+        public:
+        interner() = default;
+
+        interner(const interner &) = delete;
+        interner &operator=(const interner &) = delete;
+
+        interner(interner &&) = default;
+        interner &operator=(interner &&) = default;
+
+        // the returned id stays valid after str goes away, names are copied in
+        symbol intern(std::string_view str)
+        {
+            if (auto it = this->_ids.find(str); it != this->_ids.end())
+                return it->second;
+
+            auto name = this->_strings.store(str);
+            auto sym = static_cast<symbol>(this->_names.size());
+
+            this->_names.push_back(name);
+            this->_ids.emplace(name, sym);
+            return sym;
+        }
+
+        // doesn't intern, a string that was never interned can't name anything
+        std::optional<symbol> find(std::string_view str) const
+        {
+            if (auto it = this->_ids.find(str); it != this->_ids.end())
+                return it->second;
+            return std::nullopt;
+        }
+
+        std::string_view name(symbol sym) const
+        {
+            return this->_names[index(sym)];
+        }
+
+        std::size_t size() const
+        {
+            return this->_names.size();
+        }
+    };
+} // namespace yapl
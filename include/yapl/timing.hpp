@@ -0,0 +1,60 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#pragma once
+
+#include <string_view>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace yapl
+{
+    // wall time, cpu time of the calling thread and peak rss of each phase of one input
+    struct timings
+    {
+        struct phase
+        {
+            std::string_view name;
+            // microseconds, start is relative to the first use of any timings
+            std::uint64_t start;
+            std::uint64_t wall;
+            std::uint64_t cpu;
+            // whole process, parallel jobs share it
+            std::uint64_t peak_rss_kib;
+        };
+
+        // records the time from construction to destruction, does nothing without an owner
+        struct scope
+        {
+            private:
+            timings *_owner;
+            std::string_view _name;
+            std::uint64_t _wall;
+            std::uint64_t _cpu;
+
+            public:
+            scope(timings *owner, std::string_view name);
+            ~scope();
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+        };
+
+        std::string file;
+        // lane of the trace the phases are drawn in
+        std::size_t thread;
+
+        std::vector<phase> phases;
+
+        explicit timings(std::string file, std::size_t thread = 0) :
+            file { std::move(file) }, thread { thread }, phases { } { }
+
+        // human readable table
+        std::string report() const;
+
+        // chrome trace-event objects, comma separated, for the "traceEvents" array
+        std::string trace() const;
+    };
+} // namespace yapl
@@ -2,48 +2,199 @@
 
 #pragma once
 
+#include <llvm/Target/TargetMachine.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 
 #include <yapl/lexer.hpp>
 #include <yapl/parser.hpp>
+#include <yapl/symbols.hpp>
+#include <yapl/timing.hpp>
+#include <yapl/log.hpp>
+#include <yapl/arena.hpp>
 
 #include <unordered_map>
-#include <map>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <optional>
+#include <utility>
 #include <vector>
 #include <memory>
+#include <span>
+
+#include <cstdint>
 
 namespace yapl
 {
+    enum class opt_level : std::uint8_t
+    {
+        O0, O1, O2, O3, Os
+    };
+
+    enum class emit_kind : std::uint8_t
+    {
+        object,
+        assembly,
+        llvm_ir,
+        bitcode
+    };
+
     namespace registries
     {
-        using funcs = std::vector<std::unique_ptr<ast::func::function>>;
+        // owned by unit::nodes
+        using funcs = std::vector<ast::func::function *>;
 
+        // named types sit in a flat table indexed by the symbol of their name
+        // pointers, arrays and tuples are hash-consed: a structure is created once
+        // and every later use gets the same node, so types compare by pointer
         struct types
         {
-            std::unordered_map<std::string_view, std::unique_ptr<ast::types::type>> normal;
-            std::unordered_map<std::string_view, std::unique_ptr<ast::types::pointer>> pointers;
-            std::map<std::pair<std::string_view, std::size_t>, std::unique_ptr<ast::types::array>> arrays;
+            private:
+            using type = ast::types::type;
+            using elements = std::span<const type * const>;
+
+            static std::size_t combine(std::size_t seed, std::size_t hash)
+            {
+                return seed ^ (hash + 0x9E3779B97F4A7C15 + (seed << 6) + (seed >> 2));
+            }
+
+            struct array_hash
+            {
+                std::size_t operator()(const std::pair<const type *, std::size_t> &key) const
+                {
+                    return combine(std::hash<const type *> { }(key.first), key.second);
+                }
+            };
+
+            struct elements_hash
+            {
+                std::size_t operator()(elements key) const
+                {
+                    std::size_t seed = key.size();
+                    for (auto element : key)
+                        seed = combine(seed, std::hash<const type *> { }(element));
+                    return seed;
+                }
+            };
+
+            struct elements_equal
+            {
+                bool operator()(elements lhs, elements rhs) const
+                {
+                    return std::ranges::equal(lhs, rhs);
+                }
+            };
+
+            std::unordered_map<const type *, std::unique_ptr<ast::types::pointer>> _pointers;
+            std::unordered_map<std::pair<const type *, std::size_t>, std::unique_ptr<ast::types::array>, array_hash> _arrays;
+            // keys view the elements of the tuple they map to
+            std::unordered_map<elements, std::unique_ptr<ast::types::tuple>, elements_hash, elements_equal> _tuples;
+
+            public:
+            std::vector<std::unique_ptr<type>> normal;
+
+            void add(symbol name, std::unique_ptr<type> tp)
+            {
+                auto idx = index(name);
+                if (idx >= this->normal.size())
+                    this->normal.resize(idx + 1);
+
+                if (this->normal[idx] == nullptr)
+                    this->normal[idx] = std::move(tp);
+            }
+
+            const ast::types::pointer *pointer(const type *tp)
+            {
+                auto &ret = this->_pointers[tp];
+                if (ret == nullptr)
+                    ret = std::make_unique<ast::types::pointer>(tp);
+                return ret.get();
+            }
+
+            const ast::types::array *array(const type *tp, std::size_t size)
+            {
+                auto &ret = this->_arrays[std::make_pair(tp, size)];
+                if (ret == nullptr)
+                    ret = std::make_unique<ast::types::array>(tp, size);
+                return ret.get();
+            }
+
+            const ast::types::tuple *tuple(elements elems)
+            {
+                if (auto it = this->_tuples.find(elems); it != this->_tuples.end())
+                    return it->second.get();
+
+                auto ret = std::make_unique<ast::types::tuple>(std::vector(elems.begin(), elems.end()));
+                elements key { ret->elements };
+                return this->_tuples.emplace(key, std::move(ret)).first->second.get();
+            }
         };
     } // namespace registries
 
+    struct cache;
+
     struct unit
     {
+        private:
+        unit(std::string_view target, lexer::tokeniser toker);
+
+        void optimise(llvm::Module &module, opt_level level, bool time_passes);
+
+        // an error of func's codegen, at its position in the source if it has one
+        log::error error(const ast::func::function *func, const std::runtime_error &err) const;
+
+        public:
         std::string target;
         std::string filename;
 
         lexer::tokeniser tokeniser;
         ast::parser parser;
 
+        // every ast::expressions, ast::statements and ast::func node of this unit
+        arena nodes;
+
+        // names of types, looked up by id after parsing
+        interner symbols;
+
         registries::types type_registry;
         registries::funcs func_registry;
 
-        llvm::LLVMContext context;
+        // owned through pointers so run() can hand both to the jit
+        std::unique_ptr<llvm::LLVMContext> context;
         llvm::IRBuilder<> builder;
-        llvm::Module llmod;
+        std::unique_ptr<llvm::Module> llmod;
+
+        // set by configure(), llmod's data layout follows it
+        std::unique_ptr<llvm::TargetMachine> machine;
+
+        // errors and reports, flushed by whoever owns the unit
+        log::sink diagnostics;
+
+        // when set, every phase below is recorded here
+        timings *timer = nullptr;
 
         unit(std::string_view target, std::string_view filename);
+        unit(std::string_view target, std::string_view filename, std::string contents);
+        unit(std::string_view target, std::shared_ptr<const lexer::source> src);
+
+        // creates the target machine, before codegen so llmod gets its data layout
+        bool configure(std::string_view cpu, std::string_view features, opt_level level);
 
         bool parse();
+        // emits every parsed function into llmod, also after a failed parse() to check what did parse
+        bool codegen();
+        // runs llvm's default pipeline for the level over llmod
+        // with time_passes a per-pass timing report is added to diagnostics
+        void optimise(opt_level level, bool time_passes = false);
+        // codegen() and optimise() one function at a time, each in a module of its own whose
+        // bitcode is kept in store under the function's fingerprint. unchanged functions are
+        // loaded from there instead of being generated again, then everything is linked into llmod
+        bool incremental(const cache &store, opt_level level);
+        // writes llmod to path, object and assembly output need configure()
+        bool emit(emit_kind kind, std::string_view path);
+        // jit compiles llmod for the host, lazily one function at a time, and calls main with args
+        // returns what main returned, or nothing if it couldn't be run. consumes context and llmod
+        std::optional<int> run(const std::vector<std::string> &args);
     };
 } // namespace yapl
\ No newline at end of file
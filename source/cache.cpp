@@ -0,0 +1,97 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <yapl/cache.hpp>
+
+#include <fmt/format.h>
+
+#include <system_error>
+#include <string>
+
+namespace yapl
+{
+    namespace fs = std::filesystem;
+
+    cache::cache(fs::path dir) : _dir { std::move(dir) } { }
+
+    fs::path cache::entry(std::uint64_t key) const
+    {
+        return this->_dir / fmt::format("{:016x}", key);
+    }
+
+    std::uint64_t cache::key(std::string_view name, std::string_view source, std::string_view target, opt_level level, std::string_view cpu, std::string_view features, emit_kind kind, bool incremental)
+    {
+        // fields are nul separated so that moving bytes between them changes the key
+        std::string data;
+        for (auto field : { std::string_view { YAPL_VERSION }, name, target, cpu, features })
+        {
+            data.append(field);
+            data.push_back('\0');
+        }
+        data.push_back(static_cast<char>(level));
+        data.push_back(static_cast<char>(kind));
+        data.push_back(static_cast<char>(incremental));
+        data.append(source);
+
+        return llvm::xxHash64(llvm::StringRef { data });
+    }
+
+    bool cache::fetch(std::uint64_t key, const fs::path &path) const
+    {
+        std::error_code ec;
+        return fs::copy_file(this->entry(key), path, ec) && !ec;
+    }
+
+    // written next to the entry and renamed over it, so a concurrent
+    // yapl never reads a half written file
+    static void place(const fs::path &dest, auto &&write)
+    {
+        llvm::SmallString<128> tmp;
+        if (llvm::sys::fs::createUniqueFile(dest.string() + "-%%%%%%%%.tmp", tmp))
+            return;
+
+        fs::path path { tmp.str().str() };
+
+        std::error_code ec = write(path);
+        if (!ec)
+            fs::rename(path, dest, ec);
+        if (ec)
+            fs::remove(path, ec);
+    }
+
+    void cache::store(std::uint64_t key, const fs::path &path) const
+    {
+        place(this->entry(key), [&](const fs::path &tmp)
+        {
+            std::error_code ec;
+            fs::copy_file(path, tmp, fs::copy_options::overwrite_existing, ec);
+            return ec;
+        });
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> cache::load(std::uint64_t key) const
+    {
+        auto buffer = llvm::MemoryBuffer::getFile(this->entry(key).string());
+        if (!buffer)
+            return nullptr;
+        return std::move(*buffer);
+    }
+
+    void cache::save(std::uint64_t key, llvm::StringRef data) const
+    {
+        place(this->entry(key), [&](const fs::path &tmp)
+        {
+            std::error_code ec;
+            llvm::raw_fd_ostream out { tmp.string(), ec };
+            if (ec)
+                return ec;
+
+            out << data;
+            out.close();
+            return out.error();
+        });
+    }
+} // namespace yapl
@@ -0,0 +1,133 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <magic_enum.hpp>
+
+#include <yapl/dump.hpp>
+
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#include <string_view>
+#include <iterator>
+#include <string>
+#include <array>
+
+#include <cstring>
+#include <cstdint>
+
+namespace yapl::lexer
+{
+    namespace
+    {
+        // tokens are formatted into one large buffer that is written out whenever it fills up
+        struct writer
+        {
+            static constexpr std::size_t capacity = 1024 * 1024;
+
+            std::FILE *file;
+            std::string buffer;
+            bool failed;
+
+            explicit writer(std::FILE *file) : file { file }, buffer { }, failed { false }
+            {
+                this->buffer.reserve(capacity + 4096);
+            }
+
+            void flush()
+            {
+                if (std::fwrite(this->buffer.data(), 1, this->buffer.size(), this->file) != this->buffer.size())
+                    this->failed = true;
+                this->buffer.clear();
+            }
+
+            void maybe_flush()
+            {
+                if (this->buffer.size() >= capacity)
+                    this->flush();
+            }
+
+            bool finish()
+            {
+                this->flush();
+                return std::fflush(this->file) == 0 && !this->failed;
+            }
+
+            void varint(std::uint32_t value)
+            {
+                while (value >= 0x80)
+                {
+                    this->buffer.push_back(static_cast<char>(value | 0x80));
+                    value >>= 7;
+                }
+                this->buffer.push_back(static_cast<char>(value));
+            }
+        };
+
+        // looked up once per type rather than once per token
+        const auto &type_names()
+        {
+            static const auto names = []
+            {
+                std::array<std::string_view, 256> ret { };
+                for (std::size_t i = 0; i < ret.size(); i++)
+                    ret[i] = magic_enum::enum_name(static_cast<token_type>(i));
+                return ret;
+            }();
+            return names;
+        }
+    } // namespace
+
+    bool dump_text(const tokeniser &toker, std::FILE *out)
+    {
+        const auto &table = toker.tokens();
+        const auto text = toker.src().text();
+        const auto &names = type_names();
+
+        writer wr { out };
+
+        // tokens come in source order, so lines are counted while walking instead of looked up
+        std::size_t line = 1;
+        std::uint32_t line_start = 0;
+        std::uint32_t scanned = 0;
+
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            const auto offset = table.offsets[i];
+            for (const char *ptr = text.data() + scanned, *end = text.data() + offset;
+                (ptr = static_cast<const char *>(std::memchr(ptr, '\n', end - ptr))) != nullptr; )
+            {
+                line++;
+                line_start = static_cast<std::uint32_t>(++ptr - text.data());
+            }
+            scanned = offset;
+
+            fmt::format_to(std::back_inserter(wr.buffer), FMT_COMPILE("{:02}:{:02}: '{}' : {}\n"),
+                line, offset - line_start, text.substr(offset, table.lengths[i]), names[static_cast<std::uint8_t>(table.types[i])]
+            );
+            wr.maybe_flush();
+        }
+        return wr.finish();
+    }
+
+    bool dump_binary(const tokeniser &toker, std::FILE *out)
+    {
+        const auto &table = toker.tokens();
+
+        writer wr { out };
+        wr.buffer += "YTOK";
+        wr.buffer.push_back(1);
+        wr.varint(static_cast<std::uint32_t>(table.size()));
+
+        std::uint32_t prev_end = 0;
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            wr.buffer.push_back(static_cast<char>(table.types[i]));
+            wr.varint(table.offsets[i] - prev_end);
+            wr.varint(table.lengths[i]);
+
+            prev_end = table.offsets[i] + table.lengths[i];
+            wr.maybe_flush();
+        }
+        return wr.finish();
+    }
+} // namespace yapl::lexer
@@ -7,9 +7,18 @@
 #include <magic_enum.hpp>
 
 #include <yapl/lexer.hpp>
+#include <yapl/scan.hpp>
 #include <yapl/log.hpp>
 
+#include <system_error>
+#include <algorithm>
+#include <iterator>
+#include <charconv>
+#include <utility>
+#include <array>
+
 #include <cassert>
+#include <cstring>
 #include <cstdio>
 
 namespace yapl::lexer
@@ -68,7 +77,7 @@ namespace yapl::lexer
             { "<", token_type::lt },
             { ">", token_type::gt },
             { "<=", token_type::le },
-            { ">= ", token_type::ge },
+            { ">=", token_type::ge },
 
             { "?", token_type::question },
             { ":", token_type::colon },
@@ -97,6 +106,145 @@ namespace yapl::lexer
             { "null", token_type::null }
         });
 
+        constexpr bool is_operator_key(const frozen::string &key)
+        {
+            return scan::char_types[static_cast<unsigned char>(key[0])] == char_type::punct;
+        }
+
+        // maximal munch operator trie, generated from the operator entries of lookup
+        namespace operators
+        {
+            constexpr auto slots = []
+            {
+                std::array<std::int8_t, 256> slots { };
+                std::int8_t next = 0;
+                for (std::size_t chr = 0; chr < slots.size(); chr++)
+                    slots[chr] = (scan::char_types[chr] == char_type::punct) ? next++ : -1;
+                return slots;
+            } ();
+            constexpr std::size_t num_slots = 32;
+
+            struct node
+            {
+                token_type accept = token_type::eof;
+                std::array<std::uint8_t, num_slots> next { };
+            };
+
+            constexpr std::size_t capacity = []
+            {
+                std::size_t ret = 1;
+                for (const auto &[key, type] : lookup)
+                {
+                    if (is_operator_key(key))
+                        ret += key.size();
+                }
+                return ret;
+            } ();
+
+            constexpr auto trie = []
+            {
+                std::array<node, capacity> nodes { };
+                std::size_t used = 1;
+
+                for (const auto &[key, type] : lookup)
+                {
+                    if (!is_operator_key(key))
+                        continue;
+
+                    std::size_t current = 0;
+                    for (auto chr : key)
+                    {
+                        auto &next = nodes[current].next[slots[static_cast<unsigned char>(chr)]];
+                        if (next == 0)
+                            next = used++;
+                        current = next;
+                    }
+                    nodes[current].accept = type;
+                }
+                return nodes;
+            } ();
+            static_assert(capacity < 256, "operator trie doesn't fit in std::uint8_t indices");
+
+            // returns the longest operator at the start of [ptr, end) and its length, or eof and 0
+            constexpr std::pair<token_type, std::size_t> match(const char *ptr, const char *end)
+            {
+                std::pair<token_type, std::size_t> ret { token_type::eof, 0 };
+                std::size_t current = 0;
+
+                for (auto start = ptr; ptr != end; ptr++)
+                {
+                    auto slot = slots[static_cast<unsigned char>(*ptr)];
+                    if (slot < 0 || (current = trie[current].next[slot]) == 0)
+                        break;
+
+                    if (trie[current].accept != token_type::eof)
+                        ret = { trie[current].accept, ptr - start + 1 };
+                }
+                return ret;
+            }
+        } // namespace operators
+
+        // perfect hash over the identifier-like entries of lookup
+        namespace keywords
+        {
+            constexpr std::size_t size = 16;
+
+            constexpr std::size_t hash(std::string_view str, std::size_t seed)
+            {
+                auto first = static_cast<unsigned char>(str.front());
+                auto last = static_cast<unsigned char>(str.back());
+                return (((first * 31 + last + str.size()) * seed) >> 8) & (size - 1);
+            }
+
+            constexpr auto seed = []
+            {
+                for (std::size_t seed = 1; seed < 0x1000; seed++)
+                {
+                    std::array<bool, size> used { };
+                    bool collision = false;
+
+                    for (const auto &[key, type] : lookup)
+                    {
+                        if (is_operator_key(key))
+                            continue;
+
+                        auto &slot = used[hash({ key.data(), key.size() }, seed)];
+                        collision = collision || slot;
+                        slot = true;
+                    }
+
+                    if (collision == false)
+                        return seed;
+                }
+                return std::size_t(0);
+            } ();
+            static_assert(seed != 0, "no perfect hash seed for keywords");
+
+            struct entry
+            {
+                std::string_view key;
+                token_type type = token_type::eof;
+            };
+
+            constexpr auto table = []
+            {
+                std::array<entry, size> table { };
+                for (const auto &[key, type] : lookup)
+                {
+                    if (!is_operator_key(key))
+                        table[hash({ key.data(), key.size() }, seed)] = { { key.data(), key.size() }, type };
+                }
+                return table;
+            } ();
+
+            // identifier if not a keyword
+            constexpr token_type match(std::string_view str)
+            {
+                const auto &entry = table[hash(str, seed)];
+                return (entry.key == str) ? entry.type : token_type::identifier;
+            }
+        } // namespace keywords
+
         constexpr auto escapes = frozen::make_map<char, char>
         ({
             { '0', '\x00' },
@@ -110,32 +258,23 @@ namespace yapl::lexer
             { 'e', '\x1b' }
         });
 
-        char_type get_char_type(auto chr)
+        constexpr char_type get_char_type(int chr)
         {
-            if (chr == EOF)
-                return char_type::eof;
-
-            if (std::isspace(chr))
-                return char_type::space;
-
-            if (std::ispunct(chr) && chr != '_')
-                return char_type::punct;
-
-            return char_type::other;
+            return scan::classify(chr);
         }
 
-        bool is_num_type(digit_type type, auto chr)
+        constexpr bool is_num_type(digit_type type, int chr)
         {
             switch (type)
             {
                 case digit_type::binary:
                     return chr == '0' || chr == '1';
                 case digit_type::decimal:
-                    return std::isdigit(chr);
+                    return chr >= '0' && chr <= '9';
                 case digit_type::octal:
-                    return std::isdigit(chr) && (chr < '8');
+                    return chr >= '0' && chr <= '7';
                 case digit_type::hexadecimal:
-                    return std::isxdigit(chr);
+                    return (chr >= '0' && chr <= '9') || ((chr | 0x20) >= 'a' && (chr | 0x20) <= 'f');
             }
             __builtin_unreachable();
         }
@@ -143,253 +282,323 @@ namespace yapl::lexer
 
     int tokeniser::peekc()
     {
-        return this->_stream.peek();
+        if (this->_cursor == this->_source->end())
+            return EOF;
+        return static_cast<unsigned char>(*this->_cursor);
     }
 
     int tokeniser::getc()
     {
-        auto chr = this->_stream.get();
-        if (chr == '\n')
-        {
-            this->_line++;
-            this->_column = 0;
-        }
-        else this->_column++;
+        auto chr = this->peekc();
+        if (chr != EOF)
+            this->_cursor++;
 
         return chr;
     }
 
-    token tokeniser::next()
+    void tokeniser::push(token_type type, const char *start)
+    {
+        this->_table.push(type, this->offset(start), static_cast<std::uint32_t>(this->_cursor - start));
+    }
+
+    void tokeniser::next()
     {
         while (true)
         {
-            bool extra = false;
             switch (auto chr = this->getc(); get_char_type(chr))
             {
                 case char_type::eof:
-                    return { "eof", token_type::eof, this->line(), this->column() };
+                    return this->push(token_type::eof, this->_cursor);
                 case char_type::space:
-                    // return { " ", token_type::space, std::nullopt, this->line(), this->column() };
+                    this->_cursor = scan::space(this->_cursor, this->_source->end());
                     break;
                 case char_type::punct:
                     switch (chr)
                     {
                         case '"': // "strings"
                         {
-                            bool escape = false;
-                            std::string str;
-
-                            auto sline = this->line();
-                            auto scolumn = this->column();
+                            const auto start = this->_cursor - 1;
+                            const auto end = this->_source->end();
 
-                            for (chr = this->getc(); get_char_type(chr) != char_type::eof; chr = this->getc())
+                            for (auto ptr = this->_cursor; (ptr = scan::until(ptr, end, '"')) != end; ptr++)
                             {
-                                if (chr != '\\')
+                                // quote is escaped if preceded by an odd number of backslashes
+                                auto bslash = ptr;
+                                while (bslash != start + 1 && bslash[-1] == '\\')
+                                    bslash--;
+
+                                if ((ptr - bslash) % 2 == 0)
                                 {
-                                    if (escape == true)
-                                    {
-                                        if (auto iter = escapes.find(chr); iter != escapes.end())
-                                            str += iter->second;
-                                        else
-                                            str += chr;
+                                    this->_cursor = ptr + 1;
+                                    this->push(token_type::string, start);
 
-                                        escape = false;
-                                    }
-                                    else
+                                    std::string_view raw { start + 1, ptr };
+                                    if (scan::until(raw.data(), ptr, '\\') == ptr)
+                                        return;
+
+                                    // escapes only ever shrink the string
+                                    auto str = this->_strings.allocate_chars(raw.size());
+                                    std::size_t len = 0;
+                                    for (std::size_t i = 0; i < raw.size(); i++)
                                     {
-                                        if (chr == '"')
-                                            return { str, token_type::string, sline, scolumn };
-                                        str += chr;
+                                        if (raw[i] == '\\')
+                                        {
+                                            auto iter = escapes.find(raw[++i]);
+                                            str[len++] = (iter != escapes.end()) ? iter->second : raw[i];
+                                        }
+                                        else str[len++] = raw[i];
                                     }
+                                    this->_table.escaped.emplace_back(this->_table.size() - 1, std::string_view { str, len });
+                                    return;
                                 }
-                                else escape = true;
                             }
-                            throw log::error(this->filename(), sline, scolumn, "Expected closing '\"'");
+                            this->_cursor = end;
+
+                            auto [line, column] = this->locate(this->offset(start));
+                            throw log::error(this->filename(), line, column, "Expected closing '\"'");
                         }
                         case '/':
                         {
+                            const auto end = this->_source->end();
+
                             auto nchr = this->peekc();
                             if (nchr == '/') // line comment
                             {
-                                chr = this->getc();
-                                while (get_char_type(chr) != char_type::eof && chr != '\n')
-                                    chr = this->getc();
+                                this->_cursor = scan::until(this->_cursor + 1, end, '\n');
+                                if (this->_cursor != end)
+                                    this->_cursor++;
                                 break;
                             }
 
                             if (nchr == '*') /* block comment */
                             {
-                                bool close = false;
-
-                                for (chr = this->getc(); get_char_type(chr) != char_type::eof; chr = this->getc())
-                                {
-                                    if (close == true && chr == '/')
-                                        break;
-                                    close = (chr == '*');
-                                }
+                                // the opening '*' may close the comment too, "/*/" is a complete comment
+                                this->_cursor = scan::block_comment(this->_cursor, end);
                                 break;
                             }
+                            [[fallthrough]];
                         }
                         case '-':
-                            if (std::isdigit(this->peekc()))
-                                goto negative_number;
+                            if (chr == '-' && is_num_type(digit_type::decimal, this->peekc()))
+                                return this->lex_number(this->_cursor - 1);
 
                             [[fallthrough]];
                         default: // operators
                         {
-                            std::string name(1, chr);
-
-                            auto sline = this->line();
-                            auto scolumn = this->column();
+                            const auto start = this->_cursor - 1;
 
-                            for (chr = this->peekc(); get_char_type(chr) == char_type::punct; chr = this->peekc())
+                            auto [type, len] = operators::match(start, this->_source->end());
+                            if (len == 0)
                             {
-                                name += chr;
-                                if (lookup.find(frozen::string(name)) == lookup.end())
-                                {
-                                    name.erase(name.length() - 1);
-                                    break;
-                                }
-                                this->getc();
+                                auto [line, column] = this->locate(this->offset(start));
+                                throw log::error(this->filename(), line, column, "Unknown operator '{}'", std::string_view { start, 1 });
                             }
 
-                            const auto *iter = lookup.find(frozen::string(name));
-                            if (iter == lookup.end())
-                                throw log::error(this->filename(), sline, scolumn, "Unknown operator '{}'", name);
-
-                            return { name, iter->second, sline, scolumn };
+                            this->_cursor = start + len;
+                            return this->push(type, start);
                         }
                     }
                     break;
                 default:
                 {
-                    goto not_negative_number;
-
-                    negative_number:
-                    extra = true;
+                    const auto start = this->_cursor - 1;
+                    if (is_num_type(digit_type::decimal, chr))
+                        return this->lex_number(start);
 
-                    not_negative_number:
-                    std::string str(1, chr);
+                    this->_cursor = scan::word(this->_cursor, this->_source->end());
+                    return this->push(keywords::match({ start, this->_cursor }), start);
+                }
+            }
+        }
+    }
 
-                    if (extra == true)
-                        str += (chr = this->getc());
+    void tokeniser::lex_number(const char *start)
+    {
+        const auto end = this->_source->end();
+        const bool negative = (*start == '-');
 
-                    auto sline = this->line();
-                    auto scolumn = this->column();
+        auto is_digit = [&](const char *ptr) { return ptr != end && is_num_type(digit_type::decimal, *ptr); };
 
-                    const bool digit = std::isdigit(chr);
-                    auto type = digit_type::decimal;
+        auto type = digit_type::decimal;
+        auto digits = start + negative;
 
-                    if (digit == true) // numbers
-                    {
-                        bool invalid_number = false;
+        if (digits[0] == '0' && digits + 1 != end)
+        {
+            if (digits[1] == 'b')
+                type = digit_type::binary;
+            else if (digits[1] == 'x' || digits[1] == 'X')
+                type = digit_type::hexadecimal;
+            else if (get_char_type(digits[1]) == char_type::other)
+                type = digit_type::octal;
+
+            if (type != digit_type::decimal)
+                digits += (type == digit_type::octal) ? 1 : 2;
+        }
 
-                        auto fits_64bit = [&]
-                        {
-                            errno = 0;
-                            std::strtoull(str.c_str(), nullptr, 0);
-                            if (errno == ERANGE)
-                                return false;
-                            return true;
-                        };
+        number_value value { std::uint64_t(0) };
+        bool valid = false;
 
-                        auto oldc = chr;
-                        chr = this->peekc();
+        auto last = digits;
+        if (type == digit_type::decimal)
+        {
+            bool is_float = false;
 
-                        if (get_char_type(chr) != char_type::other)
-                        {
-                            if (fits_64bit() == false)
-                            {
-                                invalid_number = true;
-                                goto num_invalid;
-                            }
-                            return { str, token_type::number, sline, scolumn };
-                        }
+            while (is_digit(last))
+                last++;
 
-                        if (oldc == '0')
-                        {
-                            if (chr == 'b')
-                                type = digit_type::binary;
-                            else if (chr == 'x' || chr == 'X')
-                                type = digit_type::hexadecimal;
-                            else
-                            {
-                                type = digit_type::octal;
-                                if (is_num_type(digit_type::octal, chr) == false)
-                                    invalid_number = true;
-                            }
-                        }
+            // "1.5", not "arr[0].as<...>"
+            if (last != end && *last == '.' && is_digit(last + 1))
+            {
+                is_float = true;
+                for (last += 2; is_digit(last); last++) ;
+            }
 
-                        if (type != digit_type::decimal)
-                        {
-                            str += this->getc();
-                            chr = this->peekc();
+            if (last != end && (*last == 'e' || *last == 'E'))
+            {
+                auto exp = last + 1;
+                if (exp != end && (*exp == '+' || *exp == '-'))
+                    exp++;
 
-                            if (is_num_type(type, chr) == false)
-                                invalid_number = true;
-                        }
+                if (is_digit(exp))
+                {
+                    is_float = true;
+                    for (last = exp + 1; is_digit(last); last++) ;
+                }
+            }
 
-                        do {
-                            if (get_char_type(chr) == char_type::other && is_num_type(type, chr) == false)
-                                invalid_number = true;
+            const auto ptr = last;
+            last = scan::word(last, end);
 
-                            str += this->getc();
-                            chr = this->peekc();
-                        } while (get_char_type(chr) == char_type::other);
+            if (is_float == true)
+            {
+                double dval = 0;
+                auto [res, ec] = std::from_chars(digits, ptr, dval);
+                valid = (ec == std::errc { } && res == last);
+                value = negative ? -dval : dval;
+            }
+            else
+            {
+                std::uint64_t ival = 0;
+                auto [res, ec] = std::from_chars(digits, ptr, ival, 10);
+                valid = (ec == std::errc { } && res == last);
+                value = negative ? -ival : ival;
+            }
+        }
+        else
+        {
+            last = scan::word(digits, end);
+
+            int base = 16;
+            if (type == digit_type::binary)
+                base = 2;
+            else if (type == digit_type::octal)
+                base = 8;
+
+            std::uint64_t ival = 0;
+            auto [res, ec] = std::from_chars(digits, last, ival, base);
+            valid = (digits != last && ec == std::errc { } && res == last);
+            value = negative ? -ival : ival;
+        }
 
-                        if (fits_64bit() == false)
-                            invalid_number = true;
+        this->_cursor = last;
 
-                        num_invalid:
-                        if (invalid_number == true)
-                            throw log::error(this->filename(), sline, scolumn, "Invalid {} number '{}'", magic_enum::enum_name(type), str);
-                    }
-                    else // identifiers and more operators
-                    {
-                        for (chr = this->peekc(); get_char_type(chr) == char_type::other; chr = this->peekc())
-                            str += this->getc();
+        if (valid == false)
+        {
+            auto [line, column] = this->locate(this->offset(start));
+            throw log::error(this->filename(), line, column, "Invalid {} number '{}'", magic_enum::enum_name(type), std::string_view { start, last });
+        }
 
-                        if (const auto *iter = lookup.find(frozen::string(str)); iter != lookup.end())
-                            return { str, iter->second, sline, scolumn };
-                    }
+        this->push(token_type::number, start);
+        this->_table.numbers.emplace_back(this->_table.size() - 1, value);
+    }
 
-                    return { str, digit ? token_type::number : token_type::identifier, sline, scolumn };
-                }
-            }
+    bool tokeniser::fill(std::size_t index)
+    {
+        while (this->_table.size() <= index)
+        {
+            if (this->_table.size() != 0 && this->_table.types.back() == token_type::eof)
+                return false;
+            this->next();
         }
+        return true;
     }
 
-    token tokeniser::peek(std::size_t n)
+    token tokeniser::at(std::size_t index) const
     {
-        assert(n > 0);
+        const auto type = this->_table.types[index];
+        const auto offset = this->_table.offsets[index];
 
-        auto consume = [&]
+        if (type == token_type::eof)
+            return { "eof", type, offset, { } };
+
+        auto find = [&](const auto &entries)
         {
-            const token tok = this->next();
-            this->_peek_queue.push_back(tok);
-            if (tok.type == token_type::eof)
-            {
-                n = this->_peek_queue.size();
-                return false;
-            }
-            return true;
+            auto iter = std::lower_bound(entries.begin(), entries.end(), index,
+                [](const auto &entry, std::size_t idx) { return entry.first < idx; });
+
+            return (iter != entries.end() && iter->first == index) ? &iter->second : nullptr;
         };
 
-        for (std::size_t i = this->_peek_queue.size(); i < n; i++)
-            if (consume() == false)
-                break;
+        std::string_view name { this->_source->begin() + offset, this->_table.lengths[index] };
+        number_value value { };
 
-        return this->_peek_queue.at(n - 1);
+        if (type == token_type::string)
+        {
+            if (auto escaped = find(this->_table.escaped))
+                name = *escaped;
+            else
+                name = name.substr(1, name.length() - 2);
+        }
+        else if (type == token_type::number)
+            value = *find(this->_table.numbers);
+
+        return { name, type, offset, value };
     }
 
-    token tokeniser::get()
+    void tokeniser::tokenise()
     {
-        if (this->_peek_queue.empty() == false)
+        this->_table.reserve(this->_source->size() / 4);
+        while (this->_table.size() == 0 || this->_table.types.back() != token_type::eof)
+            this->next();
+    }
+
+    location tokeniser::locate(std::uint32_t offset) const
+    {
+        if (this->_lines.empty())
         {
-            auto ret = this->_peek_queue.front();
-            this->_peek_queue.pop_front();
-            return ret;
+            const auto begin = this->_source->begin();
+            const auto end = this->_source->end();
+
+            this->_lines.push_back(0);
+            for (auto ptr = begin; (ptr = static_cast<const char *>(std::memchr(ptr, '\n', end - ptr))) != nullptr; )
+                this->_lines.push_back(this->offset(++ptr));
         }
-        return this->next();;
+
+        auto iter = std::upper_bound(this->_lines.begin(), this->_lines.end(), offset);
+        auto line = static_cast<std::size_t>(iter - this->_lines.begin());
+        return { line, offset - *std::prev(iter) };
+    }
+
+    token tokeniser::peek(std::size_t n)
+    {
+        assert(n > 0);
+
+        auto index = this->_index + n - 1;
+        if (this->fill(index) == false)
+            index = this->_table.size() - 1;
+
+        return this->at(index);
+    }
+
+    token tokeniser::get()
+    {
+        if (this->fill(this->_index) == false)
+            return this->at(this->_table.size() - 1);
+
+        auto tok = this->at(this->_index);
+        if (tok.type != token_type::eof)
+            this->_index++;
+
+        return tok;
     }
-} // namespace yapl::lexer
\ No newline at end of file
+} // namespace yapl::lexer
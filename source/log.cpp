@@ -0,0 +1,135 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <yapl/log.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+#include <cstdlib>
+
+namespace yapl::log
+{
+    bool colours(std::FILE *file)
+    {
+        static const bool disabled = (std::getenv("NO_COLOR") != nullptr);
+        return !disabled && isatty(fileno(file));
+    }
+
+    void render(std::string &out, std::string_view prefix, level lvl, std::string_view message, bool colour)
+    {
+        if (colour)
+            fmt::format_to(std::back_inserter(out), "\033[1m{}{} \033[1m{}\033[0m", prefix, level2str(lvl, true), message);
+        else
+            fmt::format_to(std::back_inserter(out), "{}{} {}", prefix, level2str(lvl, false), message);
+    }
+
+    void error::render(std::string &out, bool colour) const
+    {
+        std::string prefix = (this->_data->line == 0)
+            ? fmt::format("{}: ", this->_data->file)
+            : fmt::format("{}:{}:{}: ", this->_data->file, this->_data->line, this->_data->column);
+
+        std::string message;
+        this->_data->message(message);
+
+        log::render(out, prefix, level::error, message, colour);
+    }
+
+    const char *error::what() const noexcept
+    {
+        if (this->_what.empty())
+        {
+            try {
+                this->render(this->_what, false);
+            }
+            catch (...)
+            {
+                return "error";
+            }
+        }
+        return this->_what.c_str();
+    }
+
+    bool sink::report(error err)
+    {
+        if (this->full())
+        {
+            this->_dropped = true;
+            return false;
+        }
+
+        this->_entries.emplace_back(std::move(err));
+        this->_errors++;
+        return true;
+    }
+
+    bool sink::report_current(std::string_view file)
+    {
+        try {
+            throw;
+        }
+        catch (const error &e)
+        {
+            return this->report(e);
+        }
+        catch (const std::exception &e)
+        {
+            return this->report(error { file, "{}", e.what() });
+        }
+    }
+
+    void sink::append(std::string text)
+    {
+        this->_entries.emplace_back(std::move(text));
+    }
+
+    void sink::sort()
+    {
+        auto key = [](const auto &entry)
+        {
+            constexpr auto last = std::numeric_limits<std::size_t>::max();
+
+            auto err = std::get_if<error>(&entry);
+            if (err == nullptr)
+                return std::tuple { last, last, last };
+            if (err->line() == 0)
+                return std::tuple { last - 1, std::size_t(0), std::size_t(0) };
+            return std::tuple { std::size_t(0), err->line(), err->column() };
+        };
+
+        std::ranges::stable_sort(this->_entries, { }, key);
+    }
+
+    std::string sink::render(bool colour) const
+    {
+        std::string out;
+        for (const auto &entry : this->_entries)
+        {
+            if (auto err = std::get_if<error>(&entry))
+            {
+                err->render(out, colour);
+                out += '\n';
+            }
+            else out += std::get<std::string>(entry);
+        }
+
+        if (this->_dropped)
+        {
+            log::render(out, "", level::note, fmt::format("Too many errors, stopped after {}", this->_limit), colour);
+            out += '\n';
+        }
+        return out;
+    }
+
+    void sink::flush(std::FILE *file)
+    {
+        auto out = this->render(colours(file));
+        std::fwrite(out.data(), 1, out.size(), file);
+        this->_entries.clear();
+        this->_errors = 0;
+        this->_dropped = false;
+    }
+} // namespace yapl::log
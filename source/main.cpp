@@ -5,11 +5,27 @@
 
 #include <fmt/ostream.h>
 
+#include <yapl/timing.hpp>
+#include <yapl/dump.hpp>
+#include <yapl/cache.hpp>
 #include <yapl/yapl.hpp>
 #include <yapl/log.hpp>
 
+#include <condition_variable>
 #include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <array>
 #include <optional>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <system_error>
+
+#include <cstdint>
+#include <cstdio>
 
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/TargetParser/Host.h>
@@ -19,9 +35,45 @@ namespace arguments
 {
     static constexpr std::string_view auto_detect_str = "<auto-detect>";
 
+    struct emit_info
+    {
+        std::string_view name;
+        yapl::emit_kind kind;
+        std::string_view extension;
+    };
+
+    static constexpr std::array<emit_info, 4> emits
+    {{
+        { "obj", yapl::emit_kind::object, ".o" },
+        { "asm", yapl::emit_kind::assembly, ".s" },
+        { "llvm", yapl::emit_kind::llvm_ir, ".ll" },
+        { "bc", yapl::emit_kind::bitcode, ".bc" }
+    }};
+
     static std::string target;
-    static std::string input;
-    static std::string output;
+    static std::vector<std::string> inputs;
+    // one per input
+    static std::vector<std::string> outputs;
+    static std::size_t jobs;
+    static std::size_t error_limit;
+
+    static yapl::opt_level opt_level;
+    static bool time_passes;
+    static bool time_report;
+    static std::optional<std::string> time_trace;
+
+    enum class dump_kind { none, text, binary };
+
+    static yapl::emit_kind emit;
+    static dump_kind dump_tokens;
+    static std::string cpu;
+    static std::string features;
+
+    static std::optional<yapl::cache> cache;
+    static bool incremental;
+
+    static bool run;
+    static std::vector<std::string> run_args;
 
     std::optional<int> parse(int argc, char **argv)
     {
@@ -33,11 +85,69 @@ namespace arguments
 
         parser.add_argument("-i", "--input")
             .required()
-            .help("specify the input file");
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .help("specify the input files");
 
         parser.add_argument("-o", "--output")
-            .default_value("a.out")
-            .help("specify the output file");
+            .help("specify the output file, or directory if there are several inputs. defaults to the input name with the extension of --emit");
+
+        parser.add_argument("--emit")
+            .default_value(std::string("obj"))
+            .help("output kind: obj, asm, llvm (textual IR) or bc (bitcode)");
+
+        parser.add_argument("--dump-tokens")
+            .help("write the token stream instead of compiling: 'text' (.tokens) or 'binary' (.tokbin). -o - writes to stdout");
+
+        parser.add_argument("-mcpu")
+            .default_value(std::string("generic"))
+            .help("cpu to generate code for, 'native' for the host's");
+
+        parser.add_argument("-mattr")
+            .default_value(std::string(""))
+            .help("target features to enable or disable, e.g. '+avx2,-sse4a'");
+
+        parser.add_argument("-O0").flag().help("don't optimise (default)");
+        parser.add_argument("-O1").flag().help("optimise");
+        parser.add_argument("-O2").flag().help("optimise more");
+        parser.add_argument("-O3").flag().help("optimise even more");
+        parser.add_argument("-Os").flag().help("optimise for size");
+
+        parser.add_argument("--time-passes")
+            .flag()
+            .help("print the time spent in each optimisation pass");
+
+        parser.add_argument("--time-report")
+            .flag()
+            .help("print the wall time, cpu time and peak memory of each compilation phase");
+
+        parser.add_argument("--time-trace")
+            .help("write the phases of every input to this file as chrome trace events (chrome://tracing, perfetto)");
+
+        parser.add_argument("--cache-dir")
+            .help("reuse outputs of earlier identical compilations stored in this directory");
+
+        parser.add_argument("--incremental")
+            .flag()
+            .help("with --cache-dir, also reuse the code of functions that didn't change. functions are optimised one at a time, so none is inlined into another");
+
+        parser.add_argument("--run")
+            .flag()
+            .help("compile the input in memory and run its main instead of writing a file");
+
+        parser.add_argument("--arg")
+            .append()
+            .default_value(std::vector<std::string> { })
+            .help("argument passed to main with --run, can be repeated");
+
+        parser.add_argument("--error-limit")
+            .default_value(std::size_t(20))
+            .scan<'u', std::size_t>()
+            .help("stop a file after this many errors, 0 means no limit");
+
+        parser.add_argument("-j", "--jobs")
+            .default_value(std::size_t(0))
+            .scan<'u', std::size_t>()
+            .help("number of files to compile in parallel, 0 means one per hardware thread");
 
         try {
             parser.parse_args(argc, argv);
@@ -49,37 +159,425 @@ namespace arguments
             return EXIT_FAILURE;
         }
 
-        if (auto fn = parser.present("-i"))
-            arguments::input = *fn;
-
-        arguments::output = parser.get<std::string>("-o");
+        arguments::inputs = parser.get<std::vector<std::string>>("-i");
         arguments::target = parser.get<std::string_view>("-t");
 
         namespace fs = std::filesystem;
         namespace log = yapl::log;
         using level = log::level;
 
-        if (!fs::exists(arguments::input))
+        arguments::opt_level = yapl::opt_level::O0;
+        std::size_t levels = 0;
+        for (auto [flag, lvl] : {
+                std::pair { "-O0", yapl::opt_level::O0 }, std::pair { "-O1", yapl::opt_level::O1 },
+                std::pair { "-O2", yapl::opt_level::O2 }, std::pair { "-O3", yapl::opt_level::O3 },
+                std::pair { "-Os", yapl::opt_level::Os }
+            })
+        {
+            if (parser.get<bool>(flag))
+            {
+                arguments::opt_level = lvl;
+                levels++;
+            }
+        }
+
+        if (levels > 1)
         {
-            log::println<level::error>("File '{}' does not exist", arguments::input);
+            log::println<level::error>("Only one optimisation level can be specified");
             return EXIT_FAILURE;
         }
 
-        if (fs::exists(arguments::output))
+        arguments::incremental = parser.get<bool>("--incremental");
+        if (arguments::incremental && !parser.is_used("--cache-dir"))
         {
-            log::println<level::error>("File '{}' already exists", arguments::output);
+            log::println<level::error>("--incremental needs --cache-dir");
             return EXIT_FAILURE;
         }
 
+        arguments::time_passes = parser.get<bool>("--time-passes");
+        arguments::time_report = parser.get<bool>("--time-report");
+        arguments::time_trace = parser.present("--time-trace");
+
+        auto emit = std::ranges::find(arguments::emits, parser.get<std::string>("--emit"), &emit_info::name);
+        if (emit == arguments::emits.end())
+        {
+            log::println<level::error>("Unknown output kind '{}'", parser.get<std::string>("--emit"));
+            return EXIT_FAILURE;
+        }
+        arguments::emit = emit->kind;
+
+        std::string_view extension = emit->extension;
+        arguments::dump_tokens = dump_kind::none;
+        if (auto dump = parser.present("--dump-tokens"))
+        {
+            if (*dump == "text")
+            {
+                arguments::dump_tokens = dump_kind::text;
+                extension = ".tokens";
+            }
+            else if (*dump == "binary")
+            {
+                arguments::dump_tokens = dump_kind::binary;
+                extension = ".tokbin";
+            }
+            else
+            {
+                log::println<level::error>("Unknown token dump format '{}'", *dump);
+                return EXIT_FAILURE;
+            }
+        }
+
+        arguments::cpu = parser.get<std::string>("-mcpu");
+        if (arguments::cpu == "native")
+            arguments::cpu = llvm::sys::getHostCPUName().str();
+
+        arguments::features = parser.get<std::string>("-mattr");
+
+        arguments::error_limit = parser.get<std::size_t>("--error-limit");
+
+        arguments::jobs = parser.get<std::size_t>("-j");
+        if (arguments::jobs == 0)
+            arguments::jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+        for (const auto &input : arguments::inputs)
+        {
+            if (!fs::exists(input))
+            {
+                log::println<level::error>("File '{}' does not exist", input);
+                return EXIT_FAILURE;
+            }
+        }
+
+        arguments::run = parser.get<bool>("--run");
+        if (arguments::run)
+        {
+            if (arguments::inputs.size() != 1)
+            {
+                log::println<level::error>("--run takes exactly one input");
+                return EXIT_FAILURE;
+            }
+
+            if (parser.is_used("-t") || parser.is_used("-o") || arguments::dump_tokens != dump_kind::none)
+            {
+                log::println<level::error>("--run always targets the host and doesn't write output");
+                return EXIT_FAILURE;
+            }
+
+            // args[0] is the program name, like it would be for an executable
+            arguments::run_args.push_back(arguments::inputs.front());
+            for (auto &arg : parser.get<std::vector<std::string>>("--arg"))
+                arguments::run_args.push_back(std::move(arg));
+
+            return std::nullopt;
+        }
+
+        auto derive = [&](const fs::path &dir, const std::string &input)
+        {
+            return (dir / fs::path(input).stem()).concat(extension).string();
+        };
+
+        // several inputs turn -o into a directory
+        std::optional<fs::path> directory;
+        if (parser.is_used("-o"))
+        {
+            auto output = parser.get<std::string>("-o");
+            if (output == "-" && (arguments::dump_tokens == dump_kind::none || arguments::inputs.size() != 1))
+            {
+                log::println<level::error>("Only the token dump of a single input can be written to stdout");
+                return EXIT_FAILURE;
+            }
+
+            if (arguments::inputs.size() == 1 && !fs::is_directory(output))
+                arguments::outputs.push_back(output);
+            else if (fs::exists(output) && !fs::is_directory(output))
+            {
+                log::println<level::error>("'{}' is not a directory, several inputs need an output directory", output);
+                return EXIT_FAILURE;
+            }
+            else directory = output;
+        }
+        else directory = fs::path { };
+
+        if (directory.has_value())
+        {
+            for (const auto &input : arguments::inputs)
+                arguments::outputs.push_back(derive(*directory, input));
+        }
+
+        auto sorted = arguments::outputs;
+        std::ranges::sort(sorted);
+        if (auto dup = std::ranges::adjacent_find(sorted); dup != sorted.end())
+        {
+            log::println<level::error>("Several inputs would be written to '{}'", *dup);
+            return EXIT_FAILURE;
+        }
+
+        for (const auto &output : arguments::outputs)
+        {
+            if (fs::exists(output))
+            {
+                log::println<level::error>("File '{}' already exists", output);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (directory.has_value() && !directory->empty())
+            fs::create_directories(*directory);
+
+        // a cached output has no pass timings to report
+        if (auto dir = parser.present("--cache-dir"); dir.has_value() && !arguments::time_passes)
+        {
+            std::error_code ec;
+            fs::create_directories(*dir, ec);
+            if (ec || !fs::is_directory(*dir))
+            {
+                log::println<level::error>("Could not use '{}' as a cache directory", *dir);
+                return EXIT_FAILURE;
+            }
+            arguments::cache.emplace(*dir);
+        }
+
         return std::nullopt;
     }
 } // namespace arguments
 
+namespace driver
+{
+    struct result
+    {
+        bool success = false;
+        yapl::log::sink diagnostics;
+        std::optional<yapl::timings> timings;
+    };
+
+    // phases outside of any input, lane 0 of the trace
+    static yapl::timings process { "yapl" };
+    static std::string trace;
+
+    static bool timing()
+    {
+        return arguments::time_report || arguments::time_trace.has_value();
+    }
+
+    static void report(const yapl::timings &timings)
+    {
+        if (arguments::time_report)
+            std::fputs(timings.report().c_str(), stderr);
+
+        if (arguments::time_trace.has_value() && !timings.phases.empty())
+        {
+            if (!trace.empty())
+                trace += ",\n";
+            trace += timings.trace();
+        }
+    }
+
+    // after a failed parse the functions that did parse are still generated, so their
+    // errors are reported along with the parse errors. nothing is emitted either way
+    static bool parse(yapl::unit &mod)
+    {
+        if (mod.parse())
+            return true;
+
+        if (mod.diagnostics.dropped() == false)
+            mod.codegen();
+        return false;
+    }
+
+    // one unit (and so one LLVMContext) per file, files are handed out to
+    // workers in order and results are printed in input order as they finish
+    bool compile_all(std::string_view target)
+    {
+        const auto count = arguments::inputs.size();
+
+        std::vector<result> results(count);
+        std::vector<bool> done(count, false);
+
+        std::mutex lock;
+        std::condition_variable cv;
+        std::atomic_size_t next = 0;
+
+        // lexing only, nothing of the unit is needed
+        auto dump = [&](std::size_t i, result &res, yapl::timings *timer)
+        {
+            try {
+                yapl::lexer::tokeniser toker { arguments::inputs[i] };
+                {
+                    yapl::timings::scope time { timer, "lexing" };
+                    toker.tokenise();
+                }
+                yapl::timings::scope time { timer, "token dump" };
+
+                const auto &output = arguments::outputs[i];
+                auto file = (output == "-") ? stdout : std::fopen(output.c_str(), "wb");
+                if (file == nullptr)
+                    throw yapl::log::error(toker.filename(), "Could not open '{}'", output);
+
+                res.success = (arguments::dump_tokens == arguments::dump_kind::text)
+                    ? yapl::lexer::dump_text(toker, file)
+                    : yapl::lexer::dump_binary(toker, file);
+
+                if (file != stdout && std::fclose(file) != 0)
+                    res.success = false;
+                if (!res.success)
+                    throw yapl::log::error(toker.filename(), "Could not write '{}'", output);
+            }
+            catch (...)
+            {
+                res.success = false;
+                res.diagnostics.report_current(arguments::inputs[i]);
+            }
+        };
+
+        auto compile = [&](std::size_t i, std::size_t lane)
+        {
+            result res;
+            if (timing())
+                res.timings.emplace(arguments::inputs[i], lane);
+
+            auto timer = res.timings.has_value() ? &*res.timings : nullptr;
+            if (arguments::dump_tokens != arguments::dump_kind::none)
+            {
+                dump(i, res, timer);
+                return res;
+            }
+            try {
+                const auto &output = arguments::outputs[i];
+                auto src = [&]
+                {
+                    yapl::timings::scope time { timer, "reading" };
+                    return std::make_shared<const yapl::lexer::source>(arguments::inputs[i]);
+                }();
+
+                // a hit skips the unit entirely
+                std::optional<std::uint64_t> key;
+                if (arguments::cache.has_value())
+                {
+                    yapl::timings::scope time { timer, "cache lookup" };
+                    key = yapl::cache::key(src->name(), src->text(), target, arguments::opt_level, arguments::cpu, arguments::features, arguments::emit, arguments::incremental);
+                    if (arguments::cache->fetch(*key, output))
+                    {
+                        res.success = true;
+                        return res;
+                    }
+                }
+
+                auto mod = [&]
+                {
+                    yapl::timings::scope time { timer, "construction" };
+                    return yapl::unit { target, std::move(src) };
+                }();
+                mod.timer = timer;
+                mod.diagnostics = yapl::log::sink { arguments::error_limit };
+
+                res.success = mod.configure(arguments::cpu, arguments::features, arguments::opt_level) && parse(mod);
+                if (res.success && key.has_value() && arguments::incremental)
+                {
+                    // functions that didn't change come out of the cache too
+                    res.success = mod.incremental(*arguments::cache, arguments::opt_level);
+                }
+                else if (res.success)
+                {
+                    res.success = mod.codegen();
+                    if (res.success)
+                        mod.optimise(arguments::opt_level, arguments::time_passes);
+                }
+
+                if (res.success)
+                    res.success = mod.emit(arguments::emit, output);
+
+                if (res.success && key.has_value())
+                    arguments::cache->store(*key, output);
+
+                res.diagnostics = std::move(mod.diagnostics);
+            }
+            catch (...)
+            {
+                res.diagnostics.report_current(arguments::inputs[i]);
+            }
+            return res;
+        };
+
+        auto worker = [&](std::size_t lane)
+        {
+            for (auto i = next++; i < count; i = next++)
+            {
+                auto res = compile(i, lane);
+
+                std::unique_lock guard { lock };
+                results[i] = std::move(res);
+                done[i] = true;
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::jthread> workers;
+        for (std::size_t i = 0; i < std::min(arguments::jobs, count); i++)
+            workers.emplace_back(worker, i + 1);
+
+        bool success = true;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::unique_lock guard { lock };
+            cv.wait(guard, [&] { return done[i] == true; });
+
+            auto res = std::move(results[i]);
+            guard.unlock();
+
+            res.diagnostics.flush(stderr);
+            if (res.timings.has_value())
+                report(*res.timings);
+
+            success = success && res.success;
+        }
+        return success;
+    }
+
+    // --run: a single file, compiled and executed in this process
+    int run(std::string_view target)
+    {
+        std::optional<int> ret;
+        yapl::log::sink diagnostics;
+
+        std::optional<yapl::timings> timings;
+        if (timing())
+            timings.emplace(arguments::inputs.front(), 1);
+
+        try {
+            auto mod = [&]
+            {
+                yapl::timings::scope time { timings.has_value() ? &*timings : nullptr, "construction" };
+                return yapl::unit { target, arguments::inputs.front() };
+            }();
+            mod.timer = timings.has_value() ? &*timings : nullptr;
+            mod.diagnostics = yapl::log::sink { arguments::error_limit };
+
+            if (mod.configure(arguments::cpu, arguments::features, arguments::opt_level) && parse(mod) && mod.codegen())
+            {
+                mod.optimise(arguments::opt_level, arguments::time_passes);
+                ret = mod.run(arguments::run_args);
+            }
+            diagnostics = std::move(mod.diagnostics);
+        }
+        catch (...)
+        {
+            diagnostics.report_current(arguments::inputs.front());
+        }
+
+        diagnostics.flush(stderr);
+        if (timings.has_value())
+            report(*timings);
+
+        return ret.value_or(EXIT_FAILURE);
+    }
+} // namespace driver
+
 void llvm_init()
 {
     llvm::InitializeAllTargetInfos();
     llvm::InitializeAllTargets();
     llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
 }
 
 auto main(int argc, char **argv) -> int
@@ -90,38 +588,43 @@ auto main(int argc, char **argv) -> int
     if (auto val = arguments::parse(argc, argv); val.has_value())
         return val.value();
 
-    llvm_init();
+    auto timer = driver::timing() ? &driver::process : nullptr;
+    {
+        yapl::timings::scope time { timer, "llvm init" };
+        llvm_init();
+    }
 
     auto target = (arguments::target == arguments::auto_detect_str)
         ? llvm::sys::getDefaultTargetTriple()
         : std::string(arguments::target);
 
-    if (std::string err; llvm::TargetRegistry::lookupTarget(target, err) == nullptr)
     {
-        log::println<level::error>("{}", err);
-        return EXIT_FAILURE;
+        yapl::timings::scope time { timer, "target lookup" };
+        if (std::string err; llvm::TargetRegistry::lookupTarget(target, err) == nullptr)
+        {
+            log::println<level::error>("{}", err);
+            return EXIT_FAILURE;
+        }
+    }
+    driver::report(driver::process);
+
+    auto ret = arguments::run
+        ? driver::run(target)
+        : (driver::compile_all(target) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    if (arguments::time_trace.has_value())
+    {
+        std::ofstream out { *arguments::time_trace };
+        out << "{\"traceEvents\":[\n" << driver::trace << "\n]}\n";
+        if (!out)
+        {
+            log::println<level::error>("Could not write '{}'", *arguments::time_trace);
+            return EXIT_FAILURE;
+        }
     }
 
-    yapl::unit mod { target, arguments::input };
-
-    mod.parse();
-
-    // while (true)
-    // {
-    //     try
-    //     {
-    //         auto [str, type, line, column] = mod.tokeniser();
-    //         if (type == yapl::lexer::token_type::eof)
-    //             break;
-
-    //         fmt::println("{:02}:{:02}: '{}' : {}", line, column, str, magic_enum::enum_name(type));
-    //     }
-    //     catch (const std::exception &e)
-    //     {
-    //         fmt::println(stderr, "{}", e.what());
-    //         return EXIT_FAILURE;
-    //     }
-    // }
+    if (ret != EXIT_SUCCESS)
+        return ret;
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
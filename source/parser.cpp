@@ -5,254 +5,685 @@
 #include <yapl/yapl.hpp>
 #include <yapl/log.hpp>
 
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
 #include <utility>
+#include <algorithm>
+#include <variant>
+#include <vector>
+#include <array>
 
 namespace yapl::ast
 {
-    const types::type *parser::get_type(std::string_view name, std::size_t array_size) const
+    const types::type *parser::get_type(symbol name) const
     {
-        if (!this->parent.type_registry.normal.contains(name))
+        auto &registry = this->parent.type_registry;
+
+        auto idx = index(name);
+        if (idx >= registry.normal.size())
             return nullptr;
 
-        auto type = this->parent.type_registry.normal.at(name).get();
+        return registry.normal[idx].get();
+    }
+
+    namespace precedence
+    {
+        // every assignment operator and nothing else
+        constexpr std::uint8_t assignment = 1;
 
-        if (array_size > 1)
+        struct entry
         {
-            auto pair = std::make_pair(name, array_size);
-            if (this->parent.type_registry.arrays.contains(pair))
-                return this->parent.type_registry.arrays.at(pair).get();
+            std::uint8_t binary = 0;
+            std::uint8_t prefix = 0;
+            bool right_assoc = false;
+        };
 
-            return (this->parent.type_registry.arrays[pair] = std::make_unique<types::array>(type, array_size)).get();
+        // 0 means the token isn't an operator in that position
+        constexpr auto table = []
+        {
+            using enum lexer::token_type;
+            std::array<entry, static_cast<std::size_t>(expressions_end) + 1> table { };
+
+            auto binary = [&](std::uint8_t prec, bool right_assoc, auto ...types) {
+                ((table[static_cast<std::size_t>(types)] = { prec, table[static_cast<std::size_t>(types)].prefix, right_assoc }), ...);
+            };
+            auto prefix = [&](std::uint8_t prec, auto ...types) {
+                ((table[static_cast<std::size_t>(types)].prefix = prec), ...);
+            };
+
+            binary(assignment, true,
+                assign, add_assign, sub_assign, mul_assign, div_assign, mod_assign,
+                bw_and_assign, bw_or_assign, bw_xor_assign, shiftl_assign, shiftr_assign,
+                log_and_assign, log_or_assign, log_xor_assign
+            );
+            binary(2, false, log_or);
+            binary(3, false, log_xor);
+            binary(4, false, log_and);
+            binary(5, false, bw_or);
+            binary(6, false, bw_xor);
+            binary(7, false, bw_and);
+            binary(8, false, eq, ne);
+            binary(9, false, lt, gt, le, ge);
+            binary(10, false, shiftl, shiftr);
+            binary(11, false, add, sub);
+            binary(12, false, mul, div, mod);
+
+            prefix(13, sub, log_not, bw_not, inc, dec);
+
+            return table;
+        }();
+
+        constexpr std::uint8_t binary(lexer::token_type type)
+        {
+            return table[static_cast<std::size_t>(type)].binary;
         }
-        else if (array_size == 1)
+
+        constexpr std::uint8_t prefix(lexer::token_type type)
         {
-            if (this->parent.type_registry.pointers.contains(name))
-                return this->parent.type_registry.pointers.at(name).get();
+            return table[static_cast<std::size_t>(type)].prefix;
+        }
 
-            return (this->parent.type_registry.pointers[name] = std::make_unique<types::pointer>(type)).get();
+        constexpr bool right_assoc(lexer::token_type type)
+        {
+            return table[static_cast<std::size_t>(type)].right_assoc;
         }
 
-        return type;
-    }
+        // the operand of these is stored to
+        constexpr bool stores(lexer::token_type type, bool unary)
+        {
+            if (unary)
+                return type == lexer::token_type::inc || type == lexer::token_type::dec;
+            return binary(type) == assignment;
+        }
+    } // namespace precedence
 
-#define YAPL_EXPECT(x, exp)                                                                               \
-    do {                                                                                                  \
-        if (!(x)) {                                                                                       \
-            if (should_throw)                                                                             \
-                throw log::error(this->parent.filename, line, column, "Expected {}, got '{}'", exp, str); \
-            else                                                                                          \
-                throw log::empty_error { };                                                               \
-        }                                                                                                 \
+// a diagnostic, parsing can't continue
+#define YAPL_EXPECT(x, exp)                                                                           \
+    do {                                                                                              \
+        if (!(x))                                                                                     \
+            throw this->error(tok, "Expected {}, got '{}'", exp, str);                                \
+    } while (0)
+
+// a diagnostic if should_throw, otherwise an empty result the speculating caller backs out of
+#define YAPL_SPECULATE(x, exp)                                                                        \
+    do {                                                                                              \
+        if (!(x)) {                                                                                   \
+            if (should_throw)                                                                         \
+                throw this->error(tok, "Expected {}, got '{}'", exp, str);                            \
+            return std::nullopt;                                                                      \
+        }                                                                                             \
     } while (0)
 
 #define YAPL_EXPECT_TOK(x, exp) YAPL_EXPECT(type == x, exp)
+#define YAPL_SPECULATE_TOK(x, exp) YAPL_SPECULATE(type == x, exp)
 
-    std::tuple<std::string, std::size_t> parser::parse_type(lexer::tokeniser &toker_parent, lexer::token tok, bool should_throw)
+    detail::result<const types::type *> parser::parse_type(lexer::tokeniser &toker, lexer::token tok, bool should_throw, lexer::token *unknown)
     {
-        auto &[str, type, line, column] = tok;
+        auto &[str, type, offset, value] = tok;
+        const types::type *vtype = nullptr;
+
+        if (type == lexer::token_type::open_round)
+        {
+            nested level { this->_nesting };
+            if (level.depth > max_depth)
+            {
+                if (should_throw)
+                    throw this->error(tok, "Type is nested too deeply");
+                return std::nullopt;
+            }
+
+            // (type, ...) is a tuple, a single type in parentheses is just that type
+            std::vector<const types::type *> elements;
+            do {
+                tok = toker();
+                auto first = tok;
+
+                auto element = this->parse_type(toker, tok, should_throw, unknown);
+                if (element.has_value() == false)
+                    return std::nullopt;
 
-        YAPL_EXPECT_TOK(lexer::token_type::identifier, "a type");
-        auto vtype = str;
+                if (types::is_void(*element))
+                    throw this->error(first, "Type 'void' can't be part of a tuple");
 
-        auto tmp_tok = toker_parent;
-        tok = tmp_tok.peek();
+                elements.push_back(*element);
+                tok = toker();
+            } while (type == lexer::token_type::comma);
 
-        std::size_t array_size = 0;
-        if (type == lexer::token_type::open_square)
+            YAPL_SPECULATE_TOK(lexer::token_type::close_round, "')'");
+
+            if (std::ranges::find(elements, nullptr) == elements.end())
+                vtype = (elements.size() == 1) ? elements.front() : this->parent.type_registry.tuple(elements);
+        }
+        else
         {
-            tmp_tok();
-            tok = tmp_tok();
+            YAPL_SPECULATE_TOK(lexer::token_type::identifier, "a type");
+
+            if (auto sym = this->parent.symbols.find(str))
+                vtype = this->get_type(*sym);
 
-            if (type != lexer::token_type::close_square)
+            if (vtype == nullptr)
             {
-                if (type != lexer::token_type::number || str.starts_with('-') || str.find('.') != std::string::npos)
-                    throw log::error(this->parent.filename, line, column, "Array size must be a positive integer");
+                if (unknown == nullptr)
+                {
+                    if (should_throw)
+                        throw this->error(tok, "Type '{}' does not exist", str);
+                    return std::nullopt;
+                }
 
-                array_size = std::stoull(str, nullptr, 0);
-                if (array_size < 2)
-                    throw log::error(this->parent.filename, line, column, "Array size must be more than 1");
+                if (unknown->type == lexer::token_type::eof)
+                    *unknown = tok;
+            }
+        }
+
+        // suffixes apply left to right, type[2][3] is an array of three type[2]
+        while (toker.peek().type == lexer::token_type::open_square)
+        {
+            auto open = toker();
+            if (types::is_void(vtype))
+                throw this->error(open, "Type 'void' can't have pointers or arrays");
 
-                tok = tmp_tok();
+            tok = toker();
 
-                YAPL_EXPECT_TOK(lexer::token_type::close_square, "']'");
+            if (type == lexer::token_type::close_square)
+            {
+                // type[] means pointer
+                if (vtype != nullptr)
+                    vtype = this->parent.type_registry.pointer(vtype);
+                continue;
             }
-            else array_size = 1; // <- type[] means pointer
+
+            if (type != lexer::token_type::number || str.starts_with('-') || !std::holds_alternative<std::uint64_t>(value))
+                throw this->error(tok, "Array size must be a positive integer");
+
+            auto array_size = std::get<std::uint64_t>(value);
+            if (array_size < 2)
+                throw this->error(tok, "Array size must be more than 1");
+
+            tok = toker();
+            YAPL_SPECULATE_TOK(lexer::token_type::close_square, "']'");
+
+            if (vtype != nullptr)
+                vtype = this->parent.type_registry.array(vtype, array_size);
         }
 
-        toker_parent = tmp_tok;
-        return std::make_tuple(vtype, array_size);
+        return vtype;
     }
 
-    std::tuple<std::string, std::string, std::size_t> parser::parse_variable(lexer::tokeniser &toker_parent, lexer::token tok, bool should_throw)
+    detail::result<std::tuple<std::string_view, const types::type *>> parser::parse_variable(lexer::tokeniser &toker, lexer::token tok, bool should_throw)
     {
-        auto [vtype, array_size] = this->parse_type(toker_parent, tok, should_throw);
+        // most statements that aren't declarations are out after one peek, before any name lookup
+        if (should_throw == false && tok.type == lexer::token_type::identifier)
+        {
+            auto next = toker.peek().type;
+            if (next != lexer::token_type::colon && next != lexer::token_type::open_square)
+                return std::nullopt;
+        }
 
-        auto tmp_tok = toker_parent;
-        tok = tmp_tok();
+        // an undefined type is only an error once this is known to be a declaration
+        lexer::token unknown { };
+        const auto first = tok;
 
-        auto &[str, type, line, column] = tok;
+        auto vtype = this->parse_type(toker, tok, should_throw, &unknown);
+        if (vtype.has_value() == false)
+            return std::nullopt;
 
-        YAPL_EXPECT_TOK(lexer::token_type::colon, "':'");
+        tok = toker();
 
-        tok = tmp_tok();
-        YAPL_EXPECT_TOK(lexer::token_type::identifier, "a variable name");
+        auto &[str, type, offset, value] = tok;
 
-        toker_parent = tmp_tok;
-        return std::make_tuple(str, vtype, array_size);
+        YAPL_SPECULATE_TOK(lexer::token_type::colon, "':'");
+
+        tok = toker();
+        YAPL_SPECULATE_TOK(lexer::token_type::identifier, "a variable name");
+
+        if (*vtype == nullptr)
+            throw this->error(unknown, "Type '{}' does not exist", unknown.name);
+        if (types::is_void(*vtype))
+            throw this->error(first, "Variable '{}' can't be of type 'void'", str);
+
+        return std::make_tuple(str, *vtype);
     }
 
-    std::unique_ptr<expressions::expression> parser::parse_expression(lexer::tokeniser &toker_parent, lexer::token tok, bool should_throw)
+    void parser::reduce(std::uint8_t prec, bool right_assoc, std::size_t floor)
     {
-        // TODO
-        return nullptr;
+        while (this->_operators.size() > floor)
+        {
+            auto [op, top, unary, op_offset] = this->_operators.back();
+            if (top < prec || (top == prec && right_assoc))
+                break;
+
+            this->_operators.pop_back();
+
+            // only variables can be stored to for now
+            auto target = this->_operands.end()[unary ? -1 : -2];
+            if (precedence::stores(op, unary) && dynamic_cast<expressions::identifier *>(target) == nullptr)
+                throw this->error(op_offset, "Expression is not assignable");
+
+            auto &operand = this->_operands.back();
+            if (unary)
+                operand = this->parent.nodes.make<expressions::unaryop>(op, operand, op_offset, this->_builtins.boolean);
+            else
+            {
+                auto right = operand;
+                this->_operands.pop_back();
+
+                auto &left = this->_operands.back();
+                left = this->parent.nodes.make<expressions::binaryop>(op, left, right, op_offset, this->_builtins.boolean);
+            }
+
+            if (this->_operands.back()->depth > max_depth)
+                throw this->error(op_offset, "Expression is nested too deeply");
+        }
     }
 
-    std::unique_ptr<func::function> parser::parse_function(lexer::tokeniser &toker_parent, lexer::token tok, bool should_throw)
+    expressions::expression *parser::parse_expression(lexer::tokeniser &toker, lexer::token tok)
     {
-        auto &[str, type, line, column] = tok;
+        auto &[str, type, offset, value] = tok;
+
+        // call arguments nest, everything below floor belongs to an enclosing expression
+        const auto floor = this->_operators.size();
+
+        std::size_t parens = 0;
+        bool want_operand = true;
+
+        while (true)
+        {
+            if (want_operand)
+            {
+                if (auto prec = precedence::prefix(type))
+                    this->_operators.push_back({ type, prec, true, offset });
+                else if (type == lexer::token_type::open_round)
+                {
+                    this->_operators.push_back({ type, 0, false, offset });
+                    parens++;
+                }
+                else
+                {
+                    expressions::expression *operand = nullptr;
+                    switch (type)
+                    {
+                        case lexer::token_type::_true:
+                        case lexer::token_type::_false:
+                            operand = this->parent.nodes.make<expressions::boolean>(type == lexer::token_type::_true, this->_builtins.boolean);
+                            break;
+                        case lexer::token_type::number:
+                            operand = this->parent.nodes.make<expressions::number>(value, this->literal_type(value));
+                            break;
+                        case lexer::token_type::string:
+                            operand = this->parent.nodes.make<expressions::string>(str, this->_builtins.string);
+                            break;
+                        case lexer::token_type::identifier:
+                        {
+                            if (toker.peek().type == lexer::token_type::open_round)
+                            {
+                                operand = this->parse_call(toker, tok);
+                                break;
+                            }
+
+                            auto var = this->_scope.find(str);
+                            if (var == this->_scope.end())
+                                throw this->error(tok, "Variable '{}' does not exist", str);
+
+                            operand = this->parent.nodes.make<expressions::identifier>(var->second);
+                            break;
+                        }
+                        default:
+                            throw this->error(tok, "Expected an expression, got '{}'", str);
+                    }
+
+                    this->_operands.push_back(operand);
+                    want_operand = false;
+                    continue;
+                }
+
+                tok = toker();
+                continue;
+            }
+
+            // the terminating token is left for the caller
+            auto next = toker.peek();
+
+            if (next.type == lexer::token_type::close_round && parens > 0)
+            {
+                toker();
+                this->reduce(1, false, floor);
+                this->_operators.pop_back();
+                parens--;
+                continue;
+            }
+
+            // "a-1" is lexed as 'a' and '-1'
+            if (next.type == lexer::token_type::number && next.name.starts_with('-'))
+            {
+                toker();
+                this->reduce(precedence::binary(lexer::token_type::sub), false, floor);
+                this->_operators.push_back({ lexer::token_type::sub, precedence::binary(lexer::token_type::sub), false, next.offset });
+
+                auto negated = std::visit([](auto val) -> lexer::number_value { return -val; }, next.value);
+                this->_operands.push_back(this->parent.nodes.make<expressions::number>(negated, this->literal_type(negated)));
+                continue;
+            }
+
+            auto prec = precedence::binary(next.type);
+            if (prec == 0)
+            {
+                if (parens > 0)
+                    throw this->error(next, "Expected ')', got '{}'", next.name);
+                break;
+            }
+
+            auto right_assoc = precedence::right_assoc(next.type);
+            this->reduce(prec, right_assoc, floor);
+            this->_operators.push_back({ next.type, prec, false, next.offset });
+
+            toker();
+            tok = toker();
+            want_operand = true;
+        }
+
+        this->reduce(1, false, floor);
+
+        auto expr = this->_operands.back();
+        this->_operands.pop_back();
+        return expr;
+    }
+
+    expressions::expression *parser::parse_call(lexer::tokeniser &toker, lexer::token tok)
+    {
+        auto &[str, type, offset, value] = tok;
+        auto name = str;
+        const auto start = offset;
+
+        nested level { this->_nesting };
+        if (level.depth > max_depth)
+            throw this->error(tok, "Expression is nested too deeply");
+
+        // functions can be defined after their callers, parse() resolves calls at the end
+        std::vector<expressions::expression *> args;
+
+        toker();
+        tok = toker();
+
+        if (type != lexer::token_type::close_round)
+        {
+            while (true)
+            {
+                args.push_back(this->parse_expression(toker, tok));
+
+                tok = toker();
+                if (type != lexer::token_type::comma)
+                    break;
+
+                tok = toker();
+            }
+            YAPL_EXPECT_TOK(lexer::token_type::close_round, "')'");
+        }
+
+        auto call = this->parent.nodes.make<expressions::call>(name, std::move(args), start);
+        if (call->depth > max_depth)
+            throw this->error(start, "Expression is nested too deeply");
+
+        this->_calls.push_back(call);
+        return call;
+    }
+
+    func::function *parser::parse_function(lexer::tokeniser &toker, lexer::token tok)
+    {
+        auto &[str, type, offset, value] = tok;
+        this->_function = { };
         YAPL_EXPECT_TOK(lexer::token_type::func, "a function entry");
+        const auto start = offset;
 
-        auto tmp_tok = toker_parent;
-        tok = tmp_tok();
+        tok = toker();
 
         YAPL_EXPECT_TOK(lexer::token_type::identifier, "a function name");
         auto func_name = str;
+        const auto name_offset = offset;
+        this->_function = func_name;
+
+        this->_scope.clear();
+        this->_calls.clear();
+        this->_operands.clear();
+        this->_operators.clear();
 
         auto read_params = [&]
         {
             YAPL_EXPECT_TOK(lexer::token_type::open_round, "'('");
 
-            std::vector<std::unique_ptr<statements::variable>> parameters;
+            std::vector<statements::variable *> parameters;
             bool first_param = true;
             while (true)
             {
-                tok = tmp_tok();
+                tok = toker();
                 if (type == lexer::token_type::close_round)
                     break;
 
                 if (first_param == false)
                 {
                     YAPL_EXPECT_TOK(lexer::token_type::comma, "','");
-                    tok = tmp_tok();
+                    tok = toker();
                 }
                 else first_param = false;
 
-                auto [param_name, param_type, array_size] = this->parse_variable(tmp_tok, tok, should_throw);
-
-                auto ptype = this->get_type(param_type, array_size);
-                if (ptype == nullptr)
-                    throw log::error(this->parent.filename, line, column, "Type '{}' does not exist", str);
-
-                parameters.emplace_back(
-                    std::make_unique<statements::variable>(
-                        ptype, param_name
-                    )
-                );
+                const auto param_offset = offset;
+                auto [param_name, ptype] = *this->parse_variable(toker, tok);
+                auto param = this->parent.nodes.make<statements::variable>(ptype, param_name, param_offset);
+                this->_scope[param->name] = param;
+                parameters.push_back(param);
             }
             YAPL_EXPECT_TOK(lexer::token_type::close_round, "')'");
 
             return parameters;
         };
 
-        tok = tmp_tok();
+        tok = toker();
         auto parameters = read_params();
-        tok = tmp_tok();
+        tok = toker();
 
-        const types::type *ret_type = nullptr;
+        const types::type *ret_type = this->get_type(*this->parent.symbols.find("void"));
         bool is_ret_void = true;
 
         if (type == lexer::token_type::rarrow)
         {
-            tok = tmp_tok();
-
-            auto [type_name, array_size] = this->parse_type(tmp_tok, tok, should_throw);
+            tok = toker();
 
-            ret_type = this->get_type(type_name, array_size);
-            if (ret_type == nullptr)
-                throw log::error(this->parent.filename, line, column, "Type '{}' does not exist", type_name);
+            ret_type = *this->parse_type(toker, tok);
+            is_ret_void = types::is_void(ret_type);
 
-            is_ret_void = (type_name == "void");
-
-            tok = tmp_tok();
+            tok = toker();
         }
         YAPL_EXPECT_TOK(lexer::token_type::open_curly, "'{'");
-        tok = tmp_tok();
 
         std::vector<statements::statement *> body;
-        std::size_t levels = 0;
-
-        if (type == lexer::token_type::close_curly)
-            goto skip;
-
-        while (true) // TODO: wth is this abomination
+        while (true)
         {
-            if (type == lexer::token_type::ret)
-            {
-                tok = tmp_tok();
+            auto from = toker.save();
 
-                if (is_ret_void == false)
-                {
-                    YAPL_EXPECT(lexer::is_expression(type) || type == lexer::token_type::open_curly, "an expression");
+            tok = toker();
+            if (type == lexer::token_type::close_curly)
+                break;
+            const auto stmt_offset = offset;
 
-                    body.push_back(new statements::return_statement(this->parse_expression(tmp_tok, tok)));
-                    tok = tmp_tok();
-                }
-                else body.push_back(new statements::return_statement(nullptr));
+            // a declaration that fails past its type still names a variable
+            detail::result<std::tuple<std::string_view, const types::type *>> var;
 
-                YAPL_EXPECT_TOK(lexer::token_type::semicolon, "';'");
-            }
-            else
-            {
-                try {
-                    auto [vname, vtypename, array_size] = this->parse_variable(tmp_tok, tok, false);
-                    std::unique_ptr<expressions::expression> value { nullptr };
+            // the body was never closed, that's the one error here
+            YAPL_EXPECT(type != lexer::token_type::eof && type != lexer::token_type::func, "'}'");
+
+            try {
+                if (type == lexer::token_type::semicolon)
+                    ; // empty statement
+                else if (type == lexer::token_type::ret)
+                {
+                    tok = toker();
 
-                    tok = tmp_tok();
-                    if (type == lexer::token_type::assign)
+                    if (is_ret_void == false)
                     {
-                        tok = tmp_tok();
-                        value = this->parse_expression(tmp_tok, tok);
-                        tok = tmp_tok();
+                        body.push_back(this->parent.nodes.make<statements::return_statement>(this->parse_expression(toker, tok), ret_type, stmt_offset));
+                        tok = toker();
                     }
-                    YAPL_EXPECT_TOK(lexer::token_type::semicolon, "';'");
+                    else body.push_back(this->parent.nodes.make<statements::return_statement>(nullptr, ret_type, stmt_offset));
 
-                    auto vtype = this->get_type(vtypename, array_size);
-                    if (vtype == nullptr)
-                        throw log::error(this->parent.filename, line, column, "Type '{}' does not exist", vtypename);
+                    YAPL_EXPECT_TOK(lexer::token_type::semicolon, "';'");
+                }
+                else
+                {
+                    auto cp = toker.save();
+                    if ((var = this->parse_variable(toker, tok, false)))
+                    {
+                        auto [vname, vtype] = *var;
+                        expressions::expression *init = nullptr;
+
+                        tok = toker();
+                        if (type == lexer::token_type::assign)
+                        {
+                            tok = toker();
+                            init = this->parse_expression(toker, tok);
+                            tok = toker();
+                        }
+                        YAPL_EXPECT_TOK(lexer::token_type::semicolon, "';'");
+
+                        // in scope after its initialiser, "x = x" doesn't see itself
+                        auto decl = this->parent.nodes.make<statements::variable>(vtype, vname, stmt_offset, init);
+                        this->_scope[decl->name] = decl;
+                        body.push_back(decl);
+                    }
+                    else
+                    {
+                        toker.rewind(cp);
 
-                    body.emplace_back(new statements::variable(vtype, vname));
+                        auto expr = this->parse_expression(toker, tok);
+                        body.push_back(this->parent.nodes.make<statements::expression_statement>(expr));
 
-                    goto end;
+                        tok = toker();
+                        YAPL_EXPECT_TOK(lexer::token_type::semicolon, "';'");
+                    }
                 }
-                catch (const log::empty_error &) { }
-                catch (...) { throw; }
             }
-            end:
+            catch (const log::error &e)
+            {
+                // over the limit the whole parse stops, parse() sees the sink is full
+                if (this->parent.diagnostics.report(e) == false)
+                    throw;
 
-            tok = tmp_tok();
-            if (levels == 0 && type == lexer::token_type::close_curly)
-                break;
+                // declared without its initialiser, so later uses aren't errors of their own
+                if (var.has_value() && this->_scope.contains(std::get<0>(*var)) == false)
+                {
+                    auto [vname, vtype] = *var;
+                    auto decl = this->parent.nodes.make<statements::variable>(vtype, vname, stmt_offset);
+                    this->_scope[decl->name] = decl;
+                    body.push_back(decl);
+                }
+
+                this->synchronise(toker, from, true);
+
+                if (auto next = toker.peek(); next.type == lexer::token_type::func || next.type == lexer::token_type::eof)
+                    throw this->error(next, "Expected '}}', got '{}'", next.name);
+            }
         }
 
-        skip:
-        toker_parent = tmp_tok;
-        return std::make_unique<func::function>(func_name, std::move(parameters), ret_type, std::move(body));
+        auto source = toker.src().text().substr(start, offset + str.size() - start);
+        auto func = this->parent.nodes.make<func::function>(std::string(func_name), std::move(parameters), ret_type, std::move(body), source, name_offset);
+        func->calls = std::move(this->_calls);
+        return func;
     }
+#undef YAPL_SPECULATE_TOK
+#undef YAPL_SPECULATE
 #undef YAPL_EXPECT_TOK
 #undef YAPL_EXPECT
 
+    void parser::synchronise(lexer::tokeniser &toker, lexer::tokeniser::checkpoint from, bool statement)
+    {
+        this->_operands.clear();
+        this->_operators.clear();
+
+        // everything before the offending token was fine
+        toker.rewind(from);
+        while (toker.peek().offset < this->_error_offset && toker.peek().type != lexer::token_type::eof)
+            toker();
+
+        std::size_t depth = 0;
+        while (true)
+        {
+            auto next = toker.peek();
+            switch (next.type)
+            {
+                case lexer::token_type::eof:
+                case lexer::token_type::func:
+                    return;
+                case lexer::token_type::open_curly:
+                    depth++;
+                    break;
+                case lexer::token_type::close_curly:
+                    if (statement && depth == 0)
+                        return;
+                    if (depth > 0)
+                        depth--;
+                    break;
+                case lexer::token_type::semicolon:
+                    if (statement && depth == 0)
+                    {
+                        toker();
+                        return;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            toker();
+        }
+    }
+
     void parser::parse()
     {
-        auto tok = this->tokeniser();
-        auto &[str, type, line, column] = tok;
+        // names of functions that didn't parse, calls to them aren't errors of their own
+        std::unordered_set<std::string_view> failed;
+
+        auto builtin = [&](std::string_view name) { return this->get_type(*this->parent.symbols.find(name)); };
+        this->_builtins = { builtin("bool"), builtin("i64"), builtin("f64"), builtin("string") };
 
         while (true)
         {
-            if (type == lexer::token_type::eof)
+            auto from = this->tokeniser.save();
+
+            auto tok = this->tokeniser();
+            if (tok.type == lexer::token_type::eof)
                 break;
 
-            this->parent.func_registry.push_back(this->parse_function(this->tokeniser, tok));
-            tok = this->tokeniser();
+            try {
+                this->parent.func_registry.push_back(this->parse_function(this->tokeniser, tok));
+            }
+            catch (const log::error &e)
+            {
+                if (this->_function.empty() == false)
+                    failed.insert(this->_function);
+
+                if (this->parent.diagnostics.report(e) == false)
+                    break;
+
+                this->synchronise(this->tokeniser, from, false);
+
+                // always make progress, even if the error was at this very 'fun'
+                if (this->tokeniser.save().index == from.index)
+                    this->tokeniser();
+            }
+        }
+
+        // the first definition of a name is the one calls go to, codegen reports the others
+        std::unordered_map<std::string_view, func::function *> funcs;
+        for (auto func : this->parent.func_registry)
+            funcs.emplace(func->name, func);
+
+        for (auto func : this->parent.func_registry)
+        {
+            for (auto call : func->calls)
+            {
+                if (auto it = funcs.find(call->name); it != funcs.end())
+                    call->callee = it->second;
+                else if (failed.contains(call->name))
+                    func->incomplete = true;
+            }
         }
     }
 } // namespace yapl::ast
\ No newline at end of file
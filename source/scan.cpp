@@ -0,0 +1,247 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <yapl/scan.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define YAPL_SCAN_X86 1
+#endif
+
+namespace yapl::lexer::scan
+{
+    namespace
+    {
+        constexpr bool is_space(unsigned char chr)
+        {
+            return char_types[chr] == char_type::space;
+        }
+
+        constexpr bool is_word(unsigned char chr)
+        {
+            return char_types[chr] == char_type::other;
+        }
+
+        namespace scalar
+        {
+            const char *space(const char *ptr, const char *end)
+            {
+                while (ptr != end && is_space(*ptr))
+                    ptr++;
+                return ptr;
+            }
+
+            const char *word(const char *ptr, const char *end)
+            {
+                while (ptr != end && is_word(*ptr))
+                    ptr++;
+                return ptr;
+            }
+
+            const char *until(const char *ptr, const char *end, char chr)
+            {
+                while (ptr != end && *ptr != chr)
+                    ptr++;
+                return ptr;
+            }
+        } // namespace scalar
+
+#if YAPL_SCAN_X86
+        // vector predicates only cover the common bytes, anything they reject
+        // is rechecked with the table so results match the scalar versions exactly
+
+        namespace sse2
+        {
+            constexpr std::size_t width = 16;
+
+            __attribute__((target("sse2")))
+            inline unsigned space_mask(__m128i chunk)
+            {
+                // ' ' or '\t'..'\r'
+                auto sp = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+                auto ctl = _mm_and_si128(
+                    _mm_cmpgt_epi8(chunk, _mm_set1_epi8('\t' - 1)),
+                    _mm_cmplt_epi8(chunk, _mm_set1_epi8('\r' + 1))
+                );
+                return _mm_movemask_epi8(_mm_or_si128(sp, ctl));
+            }
+
+            __attribute__((target("sse2")))
+            inline unsigned word_mask(__m128i chunk)
+            {
+                // [0-9A-Za-z_] or >= 0x80
+                auto lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+                auto digit = _mm_and_si128(
+                    _mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1))
+                );
+                auto alpha = _mm_and_si128(
+                    _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))
+                );
+                auto under = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+                auto high = _mm_cmplt_epi8(chunk, _mm_setzero_si128());
+                return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, alpha), _mm_or_si128(under, high)));
+            }
+
+            __attribute__((target("sse2")))
+            const char *space(const char *ptr, const char *end)
+            {
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto mask = ~space_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr))) & 0xFFFF;
+                    if (mask != 0)
+                        return ptr + __builtin_ctz(mask);
+                    ptr += width;
+                }
+                return scalar::space(ptr, end);
+            }
+
+            __attribute__((target("sse2")))
+            const char *word(const char *ptr, const char *end)
+            {
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto mask = ~word_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr))) & 0xFFFF;
+                    if (mask != 0)
+                    {
+                        ptr += __builtin_ctz(mask);
+                        if (!is_word(*ptr))
+                            return ptr;
+                        ptr++;
+                        continue;
+                    }
+                    ptr += width;
+                }
+                return scalar::word(ptr, end);
+            }
+
+            __attribute__((target("sse2")))
+            const char *until(const char *ptr, const char *end, char chr)
+            {
+                const auto needle = _mm_set1_epi8(chr);
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+                    if (unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)); mask != 0)
+                        return ptr + __builtin_ctz(mask);
+                    ptr += width;
+                }
+                return scalar::until(ptr, end, chr);
+            }
+        } // namespace sse2
+
+        namespace avx2
+        {
+            constexpr std::size_t width = 32;
+
+            __attribute__((target("avx2")))
+            inline unsigned space_mask(__m256i chunk)
+            {
+                auto sp = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+                auto ctl = _mm256_and_si256(
+                    _mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('\t' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), chunk)
+                );
+                return _mm256_movemask_epi8(_mm256_or_si256(sp, ctl));
+            }
+
+            __attribute__((target("avx2")))
+            inline unsigned word_mask(__m256i chunk)
+            {
+                auto lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+                auto digit = _mm256_and_si256(
+                    _mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk)
+                );
+                auto alpha = _mm256_and_si256(
+                    _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)
+                );
+                auto under = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_'));
+                auto high = _mm256_cmpgt_epi8(_mm256_setzero_si256(), chunk);
+                return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(digit, alpha), _mm256_or_si256(under, high)));
+            }
+
+            __attribute__((target("avx2")))
+            const char *space(const char *ptr, const char *end)
+            {
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto mask = ~space_mask(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)));
+                    if (mask != 0)
+                        return ptr + __builtin_ctz(mask);
+                    ptr += width;
+                }
+                return sse2::space(ptr, end);
+            }
+
+            __attribute__((target("avx2")))
+            const char *word(const char *ptr, const char *end)
+            {
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto mask = ~word_mask(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)));
+                    if (mask != 0)
+                    {
+                        ptr += __builtin_ctz(mask);
+                        if (!is_word(*ptr))
+                            return ptr;
+                        ptr++;
+                        continue;
+                    }
+                    ptr += width;
+                }
+                return sse2::word(ptr, end);
+            }
+
+            __attribute__((target("avx2")))
+            const char *until(const char *ptr, const char *end, char chr)
+            {
+                const auto needle = _mm256_set1_epi8(chr);
+                while (static_cast<std::size_t>(end - ptr) >= width)
+                {
+                    auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+                    if (unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)); mask != 0)
+                        return ptr + __builtin_ctz(mask);
+                    ptr += width;
+                }
+                return sse2::until(ptr, end, chr);
+            }
+        } // namespace avx2
+#endif
+
+        struct implementation
+        {
+            const char *(*space)(const char *, const char *);
+            const char *(*word)(const char *, const char *);
+            const char *(*until)(const char *, const char *, char);
+        };
+
+        const implementation impl = []() -> implementation
+        {
+#if YAPL_SCAN_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return { avx2::space, avx2::word, avx2::until };
+            if (__builtin_cpu_supports("sse2"))
+                return { sse2::space, sse2::word, sse2::until };
+#endif
+            return { scalar::space, scalar::word, scalar::until };
+        } ();
+    } // namespace
+
+    const char *space(const char *ptr, const char *end)
+    {
+        return impl.space(ptr, end);
+    }
+
+    const char *word(const char *ptr, const char *end)
+    {
+        return impl.word(ptr, end);
+    }
+
+    const char *until(const char *ptr, const char *end, char chr)
+    {
+        return impl.until(ptr, end, chr);
+    }
+} // namespace yapl::lexer::scan
@@ -0,0 +1,61 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <yapl/source.hpp>
+
+#include <fmt/format.h>
+
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace yapl::lexer
+{
+    source::source(std::string filename) :
+        _name { std::move(filename) }, _storage { }, _data { nullptr }, _size { 0 }, _mapped { false }
+    {
+        if (auto fd = ::open(this->_name.c_str(), O_RDONLY | O_CLOEXEC); fd >= 0)
+        {
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+            {
+                auto size = static_cast<std::size_t>(st.st_size);
+                if (auto addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0); addr != MAP_FAILED)
+                {
+                    ::madvise(addr, size, MADV_SEQUENTIAL);
+
+                    this->_data = static_cast<const char *>(addr);
+                    this->_size = size;
+                    this->_mapped = true;
+                }
+            }
+            ::close(fd);
+
+            if (this->_mapped == true)
+                return;
+        }
+
+        // fallback for pipes, empty and otherwise unmappable files
+        std::ifstream stream { this->_name, std::ios::binary };
+        if (!stream.is_open())
+            throw std::runtime_error(fmt::format("Could not open file '{}'", this->_name));
+
+        this->_storage.assign(std::istreambuf_iterator<char> { stream }, std::istreambuf_iterator<char> { });
+        this->_data = this->_storage.data();
+        this->_size = this->_storage.size();
+    }
+
+    source::source(std::string name, std::string contents) :
+        _name { std::move(name) }, _storage { std::move(contents) },
+        _data { this->_storage.data() }, _size { this->_storage.size() }, _mapped { false } { }
+
+    source::~source()
+    {
+        if (this->_mapped == true)
+            ::munmap(const_cast<char *>(this->_data), this->_size);
+    }
+} // namespace yapl::lexer
@@ -0,0 +1,120 @@
+// Copyright (C) 2022-2024  ilobilo
+
+#include <yapl/timing.hpp>
+
+#include <fmt/format.h>
+
+#include <sys/resource.h>
+
+#include <iterator>
+#include <chrono>
+#include <ctime>
+
+namespace yapl
+{
+    namespace
+    {
+        std::uint64_t wall_now()
+        {
+            using namespace std::chrono;
+            static const auto epoch = steady_clock::now();
+            return duration_cast<microseconds>(steady_clock::now() - epoch).count();
+        }
+
+        // per thread, so phases of parallel jobs don't count each other
+        std::uint64_t cpu_now()
+        {
+            timespec ts { };
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000 + ts.tv_nsec / 1'000;
+        }
+
+        std::uint64_t peak_rss()
+        {
+            rusage usage { };
+            getrusage(RUSAGE_SELF, &usage);
+            return static_cast<std::uint64_t>(usage.ru_maxrss); // KiB on linux
+        }
+
+        void escape(std::string &out, std::string_view str)
+        {
+            for (auto chr : str)
+            {
+                switch (chr)
+                {
+                    case '"':
+                        out += "\\\"";
+                        break;
+                    case '\\':
+                        out += "\\\\";
+                        break;
+                    default:
+                        if (static_cast<unsigned char>(chr) < 0x20)
+                            fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<int>(chr));
+                        else
+                            out += chr;
+                        break;
+                }
+            }
+        }
+    } // namespace
+
+    timings::scope::scope(timings *owner, std::string_view name) :
+        _owner { owner }, _name { name }, _wall { 0 }, _cpu { 0 }
+    {
+        if (this->_owner == nullptr)
+            return;
+
+        this->_wall = wall_now();
+        this->_cpu = cpu_now();
+    }
+
+    timings::scope::~scope()
+    {
+        if (this->_owner == nullptr)
+            return;
+
+        auto wall = wall_now();
+        auto cpu = cpu_now();
+        this->_owner->phases.push_back({ this->_name, this->_wall, wall - this->_wall, cpu - this->_cpu, peak_rss() });
+    }
+
+    std::string timings::report() const
+    {
+        std::string out;
+        auto it = std::back_inserter(out);
+
+        fmt::format_to(it, "Time report for '{}':\n", this->file);
+        fmt::format_to(it, "  {:<14} {:>12} {:>12} {:>14}\n", "phase", "wall (ms)", "cpu (ms)", "peak rss (KiB)");
+
+        std::uint64_t wall = 0, cpu = 0;
+        for (const auto &ph : this->phases)
+        {
+            fmt::format_to(it, "  {:<14} {:>12.3f} {:>12.3f} {:>14}\n", ph.name, ph.wall / 1000.0, ph.cpu / 1000.0, ph.peak_rss_kib);
+            wall += ph.wall;
+            cpu += ph.cpu;
+        }
+        fmt::format_to(it, "  {:<14} {:>12.3f} {:>12.3f}\n", "total", wall / 1000.0, cpu / 1000.0);
+
+        return out;
+    }
+
+    std::string timings::trace() const
+    {
+        std::string out;
+        for (const auto &ph : this->phases)
+        {
+            if (!out.empty())
+                out += ",\n";
+
+            out += R"({"name":")";
+            escape(out, ph.name);
+            out += R"(","cat":"yapl","ph":"X",)";
+            fmt::format_to(std::back_inserter(out), R"("ts":{},"dur":{},"pid":1,"tid":{},)", ph.start, ph.wall, this->thread);
+            out += R"("args":{"file":")";
+            escape(out, this->file);
+            fmt::format_to(std::back_inserter(out), R"(","cpu_us":{},"peak_rss_kib":{}}}}})", ph.cpu, ph.peak_rss_kib);
+        }
+        return out;
+    }
+} // namespace yapl
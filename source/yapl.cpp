@@ -1,22 +1,52 @@
 // Copyright (C) 2022-2024  ilobilo
 
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Linker/IRMover.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+
+#include <yapl/cache.hpp>
 #include <yapl/yapl.hpp>
-#include <fmt/core.h>
+#include <yapl/log.hpp>
+#include <fmt/format.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <iterator>
+#include <cstdint>
 
 namespace yapl
 {
     unit::unit(std::string_view target, std::string_view filename) :
-        target { target }, filename { filename },
-        tokeniser { std::string(filename) }, parser { tokeniser, *this },
-        context { }, builder { context }, llmod { filename, context }
+        unit { target, lexer::tokeniser { std::string(filename) } } { }
+
+    unit::unit(std::string_view target, std::string_view filename, std::string contents) :
+        unit { target, lexer::tokeniser { std::string(filename), std::move(contents) } } { }
+
+    unit::unit(std::string_view target, std::shared_ptr<const lexer::source> src) :
+        unit { target, lexer::tokeniser { std::move(src) } } { }
+
+    unit::unit(std::string_view target, lexer::tokeniser toker) :
+        target { target }, filename { toker.filename() },
+        tokeniser { std::move(toker) }, parser { tokeniser, *this }, nodes { }, symbols { },
+        context { std::make_unique<llvm::LLVMContext>() }, builder { *context },
+        llmod { std::make_unique<llvm::Module>(filename, *context) }
     {
-        this->llmod.setTargetTriple(this->target);
+        this->llmod->setTargetTriple(this->target);
 
         {
-            auto add_type = [&](auto name, auto tp)
+            auto add_type = [&](std::string_view name, auto tp)
             {
-                if (this->type_registry.normal.contains(name) == false)
-                    this->type_registry.normal[name] = std::move(tp);
+                this->type_registry.add(this->symbols.intern(name), std::move(tp));
             };
 
             add_type("i8", std::make_unique<ast::types::number>(ast::detail::num_size::i8, true));
@@ -42,16 +72,469 @@ namespace yapl
         }
     }
 
+    bool unit::configure(std::string_view cpu, std::string_view features, opt_level level)
+    {
+        timings::scope time { this->timer, "target machine" };
+        try {
+            std::string err;
+            auto target = llvm::TargetRegistry::lookupTarget(this->target, err);
+            if (target == nullptr)
+                throw log::error(this->filename, "{}", err);
+
+            auto codegen_level = [&]
+            {
+                switch (level)
+                {
+                    case opt_level::O0:
+                        return llvm::CodeGenOptLevel::None;
+                    case opt_level::O1:
+                        return llvm::CodeGenOptLevel::Less;
+                    case opt_level::O3:
+                        return llvm::CodeGenOptLevel::Aggressive;
+                    default:
+                        return llvm::CodeGenOptLevel::Default;
+                }
+            }();
+
+            this->machine.reset(target->createTargetMachine(
+                this->target, cpu, features, llvm::TargetOptions { },
+                llvm::Reloc::PIC_, std::nullopt, codegen_level
+            ));
+
+            if (this->machine == nullptr)
+                throw log::error(this->filename, "Could not create a target machine for '{}'", this->target);
+
+            this->llmod->setDataLayout(this->machine->createDataLayout());
+        }
+        catch (...)
+        {
+            this->diagnostics.report_current(this->filename);
+            return false;
+        }
+        return true;
+    }
+
+    log::error unit::error(const ast::func::function *func, const std::runtime_error &err) const
+    {
+        auto located = dynamic_cast<const ast::detail::codegen_error *>(&err);
+        if (located == nullptr)
+            return log::error(this->filename, "In function '{}': {}", func->name, err.what());
+
+        auto [line, column] = this->tokeniser.locate(located->offset);
+        return log::error(this->filename, line, column, "In function '{}': {}", func->name, err.what());
+    }
+
     bool unit::parse()
     {
+        const auto errors = this->diagnostics.errors();
         try {
+            {
+                timings::scope time { this->timer, "lexing" };
+                this->tokeniser.tokenise();
+            }
+            timings::scope time { this->timer, "parsing" };
             this->parser.parse();
         }
-        catch (const std::exception &e)
+        catch (...)
+        {
+            this->diagnostics.report_current(this->filename);
+            return false;
+        }
+
+        // recovery can report an error after one further ahead
+        this->diagnostics.sort();
+        return this->diagnostics.errors() == errors;
+    }
+
+    bool unit::codegen()
+    {
+        timings::scope time { this->timer, "codegen" };
+        try {
+            // an error in one function doesn't keep the others from being checked
+            auto each = [&](auto &&fn)
+            {
+                const auto errors = this->diagnostics.errors();
+                for (auto func : this->func_registry)
+                {
+                    try {
+                        fn(func);
+                    }
+                    catch (const std::runtime_error &e)
+                    {
+                        this->diagnostics.report(this->error(func, e));
+                    }
+
+                    // over the limit
+                    if (this->diagnostics.dropped())
+                        break;
+                }
+
+                // after a failed parse these go in between its errors
+                if (this->diagnostics.errors() == errors)
+                    return true;
+
+                this->diagnostics.sort();
+                return false;
+            };
+
+            // bodies of duplicates would go into the first definition
+            if (each([&](auto func) { func->declare(this->builder, *this->llmod); }) == false)
+                return false;
+
+            // each statement's error is reported on its own, one doesn't hide the next
+            auto body = [&](ast::func::function *func)
+            {
+                if (func->incomplete == false)
+                    func->codegen(this->builder, *this->llmod, [&](const std::runtime_error &e) { return this->diagnostics.report(this->error(func, e)); });
+            };
+            if (each(body) == false)
+                return false;
+
+            std::string errors;
+            llvm::raw_string_ostream stream { errors };
+            if (llvm::verifyModule(*this->llmod, &stream))
+                throw log::error(this->filename, "Generated invalid IR: {}", stream.str());
+        }
+        catch (...)
+        {
+            this->diagnostics.report_current(this->filename);
+            return false;
+        }
+        return true;
+    }
+
+    void unit::optimise(opt_level level, bool time_passes)
+    {
+        timings::scope time { this->timer, "optimisation" };
+        this->optimise(*this->llmod, level, time_passes);
+    }
+
+    void unit::optimise(llvm::Module &module, opt_level level, bool time_passes)
+    {
+        llvm::PassInstrumentationCallbacks callbacks;
+
+        std::string report;
+        llvm::raw_string_ostream stream { report };
+
+        llvm::TimePassesHandler timer { time_passes };
+        timer.setOutStream(stream);
+        timer.registerCallbacks(callbacks);
+
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+
+        llvm::PassBuilder passes { this->machine.get(), llvm::PipelineTuningOptions { }, std::nullopt, &callbacks };
+
+        passes.registerModuleAnalyses(mam);
+        passes.registerCGSCCAnalyses(cgam);
+        passes.registerFunctionAnalyses(fam);
+        passes.registerLoopAnalyses(lam);
+        passes.crossRegisterProxies(lam, fam, cgam, mam);
+
+        auto llvm_level = [&]
+        {
+            switch (level)
+            {
+                case opt_level::O1:
+                    return llvm::OptimizationLevel::O1;
+                case opt_level::O2:
+                    return llvm::OptimizationLevel::O2;
+                case opt_level::O3:
+                    return llvm::OptimizationLevel::O3;
+                case opt_level::Os:
+                    return llvm::OptimizationLevel::Os;
+                default:
+                    return llvm::OptimizationLevel::O0;
+            }
+        }();
+
+        // the per-module pipeline asserts on O0, it has its own
+        auto pipeline = (level == opt_level::O0)
+            ? passes.buildO0DefaultPipeline(llvm_level)
+            : passes.buildPerModuleDefaultPipeline(llvm_level);
+
+        pipeline.run(module, mam);
+
+        if (time_passes)
+        {
+            timer.print();
+            this->diagnostics.append(stream.str());
+        }
+    }
+
+    bool unit::incremental(const cache &store, opt_level level)
+    {
+        timings::scope time { this->timer, "incremental" };
+        const auto errors = this->diagnostics.errors();
+        try {
+            if (this->machine == nullptr)
+                throw log::error(this->filename, "No target machine to compile for");
+
+            // a function's code depends on its own text and on the prototypes of what it
+            // calls, so each prototype is hashed once and goes into its callers' fingerprints
+            std::unordered_map<const ast::func::function *, std::uint64_t> prototypes;
+            for (auto func : this->func_registry)
+            {
+                std::string prototype;
+                llvm::raw_string_ostream stream { prototype };
+                stream << func->name << ": ";
+                func->typegen(this->builder)->print(stream);
+                prototypes.emplace(func, llvm::xxHash64(stream.str()));
+
+                // declared up front like codegen() does, which keeps source order and catches duplicates
+                try {
+                    func->declare(this->builder, *this->llmod);
+                }
+                catch (const std::runtime_error &e)
+                {
+                    throw this->error(func, e);
+                }
+            }
+
+            // distinct, in the order of their first call
+            auto callees = [&](ast::func::function *func)
+            {
+                std::vector<ast::func::function *> ret;
+                std::unordered_set<ast::func::function *> seen { func };
+                for (auto call : func->calls)
+                {
+                    if (call->callee != nullptr && seen.insert(call->callee).second)
+                        ret.push_back(call->callee);
+                }
+                return ret;
+            };
+
+            auto fingerprint = [&](ast::func::function *func, const std::vector<ast::func::function *> &called)
+            {
+                std::string text { func->source };
+                for (auto callee : called)
+                    fmt::format_to(std::back_inserter(text), "\n{:016x}", prototypes[callee]);
+
+                return cache::key(this->filename, text, this->target, level,
+                    this->machine->getTargetCPU(), this->machine->getTargetFeatureString(), emit_kind::bitcode, true
+                );
+            };
+
+            // only the function and what it calls are declared
+            // nullptr if the function has errors, those are reported
+            auto generate = [&](ast::func::function *func, const std::vector<ast::func::function *> &called) -> std::unique_ptr<llvm::Module>
+            {
+                auto module = std::make_unique<llvm::Module>(this->filename, *this->context);
+                module->setTargetTriple(this->target);
+                module->setDataLayout(this->llmod->getDataLayout());
+
+                func->declare(this->builder, *module);
+                for (auto callee : called)
+                    callee->declare(this->builder, *module);
+                bool failed = false;
+                func->codegen(this->builder, *module, [&](const std::runtime_error &e)
+                {
+                    failed = true;
+                    return this->diagnostics.report(this->error(func, e));
+                });
+
+                if (failed)
+                    return nullptr;
+
+                std::string errors;
+                llvm::raw_string_ostream stream { errors };
+                if (llvm::verifyModule(*module, &stream))
+                    throw std::runtime_error(fmt::format("Generated invalid IR: {}", stream.str()));
+
+                this->optimise(*module, level, false);
+                return module;
+            };
+
+            // llvm::Linker walks every function of llmod for each module it links in
+            // the modules here have one definition each, which IRMover can move on its own
+            llvm::IRMover mover { *this->llmod };
+            for (auto func : this->func_registry)
+            {
+                std::unique_ptr<llvm::Module> module;
+
+                auto called = callees(func);
+                auto key = fingerprint(func, called);
+
+                // a stale or damaged entry is just a miss
+                if (auto buffer = store.load(key))
+                {
+                    if (auto loaded = llvm::parseBitcodeFile(buffer->getMemBufferRef(), *this->context))
+                        module = std::move(*loaded);
+                    else
+                        llvm::consumeError(loaded.takeError());
+                }
+
+                if (module == nullptr)
+                {
+                    try {
+                        module = generate(func, called);
+                    }
+                    catch (const std::runtime_error &e)
+                    {
+                        throw this->error(func, e);
+                    }
+
+                    // the other functions are still checked, nothing is emitted
+                    if (module == nullptr)
+                    {
+                        if (this->diagnostics.dropped())
+                            break;
+                        continue;
+                    }
+
+                    std::string bitcode;
+                    llvm::raw_string_ostream stream { bitcode };
+                    llvm::WriteBitcodeToFile(*module, stream);
+                    store.save(key, stream.str());
+                }
+
+                std::vector<llvm::GlobalValue *> values { module->getFunction(func->name) };
+                if (auto error = mover.move(std::move(module), values, [](llvm::GlobalValue &, llvm::IRMover::ValueAdder) { }, false))
+                {
+                    llvm::consumeError(std::move(error));
+                    throw log::error(this->filename, "In function '{}': Could not be linked", func->name);
+                }
+            }
+        }
+        catch (...)
         {
-            fmt::println(stderr, "{}", e.what());
+            this->diagnostics.report_current(this->filename);
+            return false;
+        }
+        return this->diagnostics.errors() == errors;
+    }
+
+    bool unit::emit(emit_kind kind, std::string_view path)
+    {
+        timings::scope time { this->timer, "emission" };
+        try {
+            auto text = (kind == emit_kind::assembly || kind == emit_kind::llvm_ir);
+
+            std::error_code ec;
+            llvm::raw_fd_ostream out { path, ec, text ? llvm::sys::fs::OF_Text : llvm::sys::fs::OF_None };
+            if (ec)
+                throw log::error(this->filename, "Could not open '{}': {}", path, ec.message());
+
+            switch (kind)
+            {
+                case emit_kind::llvm_ir:
+                    this->llmod->print(out, nullptr);
+                    break;
+                case emit_kind::bitcode:
+                    llvm::WriteBitcodeToFile(*this->llmod, out);
+                    break;
+                default:
+                {
+                    if (this->machine == nullptr)
+                        throw log::error(this->filename, "No target machine to emit code with");
+
+                    auto type = (kind == emit_kind::object)
+                        ? llvm::CodeGenFileType::ObjectFile
+                        : llvm::CodeGenFileType::AssemblyFile;
+
+                    llvm::legacy::PassManager passes;
+                    if (this->machine->addPassesToEmitFile(passes, out, nullptr, type))
+                        throw log::error(this->filename, "Target '{}' can't emit this kind of file", this->target);
+
+                    passes.run(*this->llmod);
+                    break;
+                }
+            }
+
+            out.close();
+            if (out.has_error())
+            {
+                auto err = out.error();
+                out.clear_error();
+                throw log::error(this->filename, "Could not write '{}': {}", path, err.message());
+            }
+        }
+        catch (...)
+        {
+            this->diagnostics.report_current(this->filename);
             return false;
         }
         return true;
     }
+
+    std::optional<int> unit::run(const std::vector<std::string> &args)
+    {
+        try {
+            auto check = [&]<typename Type>(llvm::Expected<Type> value) -> Type
+            {
+                if (!value)
+                    throw log::error(this->filename, "{}", llvm::toString(value.takeError()));
+                return std::move(*value);
+            };
+
+            auto main = this->llmod->getFunction("main");
+            if (main == nullptr || main->isDeclaration())
+                throw log::error(this->filename, "No 'main' function to run");
+
+            auto type = main->getFunctionType();
+            auto takes_args = (type->getNumParams() == 1 && type->getParamType(0)->isPointerTy());
+            if (type->getNumParams() != 0 && !takes_args)
+                throw log::error(this->filename, "'main' must take no parameters or a string[]");
+
+            auto ret = type->getReturnType();
+            if (!ret->isVoidTy() && !(ret->isIntegerTy() && ret->getIntegerBitWidth() <= 64))
+                throw log::error(this->filename, "'main' must return an integer or nothing");
+
+            auto jit = check(llvm::orc::LLLazyJITBuilder { }.create());
+
+            // only what main ends up calling gets compiled, each function on first call
+            jit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+
+            auto &dylib = jit->getMainJITDylib();
+            dylib.addGenerator(check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix())));
+
+            this->llmod->setTargetTriple(jit->getTargetTriple().str());
+            this->llmod->setDataLayout(jit->getDataLayout());
+
+            llvm::orc::ThreadSafeModule module { std::move(this->llmod), std::move(this->context) };
+            if (auto err = jit->addLazyIRModule(std::move(module)))
+                throw log::error(this->filename, "{}", llvm::toString(std::move(err)));
+
+            auto entry = check(jit->lookup("main")).getValue();
+
+            std::vector<char *> argv;
+            for (const auto &arg : args)
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            argv.push_back(nullptr);
+
+            auto call = [&]<typename Ret>() -> Ret
+            {
+                if (takes_args)
+                    return reinterpret_cast<Ret (*)(char **)>(entry)(argv.data());
+                return reinterpret_cast<Ret (*)()>(entry)();
+            };
+
+            if (ret->isVoidTy())
+            {
+                call.template operator()<void>();
+                return 0;
+            }
+
+            switch (ret->getIntegerBitWidth())
+            {
+                case 1:
+                    return call.template operator()<bool>();
+                case 8:
+                    return call.template operator()<std::int8_t>();
+                case 16:
+                    return call.template operator()<std::int16_t>();
+                case 32:
+                    return call.template operator()<std::int32_t>();
+                default:
+                    return static_cast<int>(call.template operator()<std::int64_t>());
+            }
+        }
+        catch (...)
+        {
+            this->diagnostics.report_current(this->filename);
+            return std::nullopt;
+        }
+    }
 } // namespace yapl
\ No newline at end of file
@@ -12,6 +12,7 @@ target("yapl")
 
     add_packages("magic_enum", "argparse", "frozen", "fmt", "llvm")
     add_links("LLVM")
+    add_syslinks("pthread")
 
     add_files("source/*.cpp")
     add_includedirs("include/")
@@ -20,6 +21,26 @@ target("yapl")
     set_warnings("all", "error")
     set_optimize("fastest")
 
+    on_config(function (target)
+        target:add("defines", "YAPL_VERSION=\"" .. target:version() .. "\"")
+    end)
+
+-- lexer and parser throughput on generated sources, see bench/bench.cpp
+target("yapl-bench")
+    set_kind("binary")
+    set_default(false)
+
+    add_packages("magic_enum", "argparse", "frozen", "fmt", "llvm")
+    add_links("LLVM")
+    add_syslinks("pthread")
+
+    add_files("source/*.cpp|main.cpp", "bench/*.cpp")
+    add_includedirs("include/")
+
+    set_languages("c++20")
+    set_warnings("all", "error")
+    set_optimize("fastest")
+
     on_config(function (target)
         target:add("defines", "YAPL_VERSION=\"" .. target:version() .. "\"")
     end)
\ No newline at end of file